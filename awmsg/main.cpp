@@ -1,9 +1,16 @@
+#include "IPCProtocol.h"
+#include <deque>
 #include <iostream>
 #include <nlohmann/json.hpp>
+#include <poll.h>
+#include <sstream>
 #include <stdarg.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include <vector>
 using json = nlohmann::json;
 
 void print_err(std::string msg, ...) {
@@ -19,101 +26,599 @@ void print_usage() {
                  "\t[h]elp\n"
                  "\t[e]xit\n"
                  "\t[o]utput\n"
-                 "\t\t- [l]ist\n"
+                 "\t\t- [l]ist [fields]\n"
                  "\t\t- [m]odes\n"
+                 "\t\t- [f]rames\n"
+                 "\t\t  frames committed, skipped without damage,\n"
+                 "\t\t  failed and torn, and frame done delay of\n"
+                 "\t\t  toplevels\n"
+                 "\t\t- [s]canout\n"
+                 "\t\t  direct scanout of fullscreen toplevels, or why\n"
+                 "\t\t  they were composited\n"
                  "\t[w]orkspace\n"
-                 "\t\t- [l]ist\n"
+                 "\t\t- [l]ist [fields]\n"
+                 "\t\t- [s]et <number> [output]\n"
+                 "\t\t- [t]ile [number] [output]\n"
                  "\t[t]oplevel\n"
-                 "\t\t- [l]ist\n"
+                 "\t\t- [l]ist [fields]\n"
+                 "\t\t- [fo]cus <id>\n"
+                 "\t\t- [c]lose <id>\n"
+                 "\t\t- [s]wap <id> <id>\n"
+                 "\t\t- [mo]ve <id> <workspace>\n"
+                 "\t\t- [fu]llscreen <id> [on|off|toggle]\n"
+                 "\t\t- [ma]ximize <id> [on|off|toggle]\n"
+                 "\t[i]nput\n"
+                 "\t\t- [p]ointer\n"
+                 "\t\t- [l]atency\n"
+                 "\t\t  time in microseconds from each input event until\n"
+                 "\t\t  it is sent to a client, by device\n"
+                 "\t\t- [e]nd-to-end\n"
+                 "\t\t  time in microseconds from an input until the first\n"
+                 "\t\t  frame after the client's next commit is presented,\n"
+                 "\t\t  by output and application\n"
+                 "\t\t- [r]eset\n"
                  "\t[k]eyboard\n"
                  "\t\t- [l]ist\n"
                  "\t[d]evice\n"
                  "\t\t- [l]ist\n"
-                 "\t\t- [c]urrent\n");
+                 "\t\t- [c]urrent\n"
+                 "\t[s]ubscribe\n"
+                 "\t\t- [f]ocus\n"
+                 "\t\t- [w]orkspace\n"
+                 "\t\t- [t]oplevel\n"
+                 "\t\t- [o]utput\n"
+                 "\t[p]age\n"
+                 "\t\t- [w]atch\n"
+                 "\t\t  read the shared memory state page, printing it again\n"
+                 "\t\t  on every change when watching\n"
+                 "\t[b]atch\n"
+                 "\t\t- read one query per line from stdin and print one\n"
+                 "\t\t  reply per line, sent over a single connection,\n"
+                 "\t\t  exits with 5 if any query fails or gets no reply\n"
+                 "Batches:\n"
+                 "\tworkspace and toplevel commands separated by `;` run\n"
+                 "\ttogether, only if all of them are valid, e.g.\n"
+                 "\t`awmsg t mo 4 2 \\; w s 2 \\; w t`\n"
+                 "Fields:\n"
+                 "\tcomma separated names of the fields to include in a\n"
+                 "\tlist, e.g. `awmsg t l title,focused`\n");
 }
 
-int main(int argc, char **argv) {
-    // print usage
-    if (argc == 1) {
-        print_usage();
-        return 0;
+// convert a query to an IPC message, returns an empty string if the query
+// is invalid
+std::string parse_query(const std::vector<std::string> &args) {
+    if (args.empty() || args[0].empty())
+        return "";
+
+    const char group = args[0][0];
+    const char command = args.size() > 1 && !args[1].empty() ? args[1][0] : 0;
+
+    // mutating commands are validated by the compositor
+    std::string joined;
+    for (const std::string &arg : args)
+        joined += (joined.empty() ? "" : " ") + arg;
+
+    if (joined.find(';') != std::string::npos)
+        return joined;
+
+    // optional field projection of lists
+    const std::string fields = args.size() > 2 ? " " + args[2] : "";
+
+    switch (group) {
+    case 'e': // exit
+        return "exit";
+    case 'o': // output
+        if (command == 'l')
+            return "o l" + fields;
+        if (command == 'm')
+            return "o m";
+        if (command == 'f')
+            return "o f";
+        if (command == 's')
+            return "o s";
+        break;
+    case 'w': // workspace
+        if (command == 'l')
+            return "w l" + fields;
+        if (command == 's' || command == 't')
+            return joined;
+        break;
+    case 't': // toplevel
+        if (command == 'l')
+            return "t l" + fields;
+        if (command && std::string("fcsm").find(command) != std::string::npos)
+            return joined;
+        break;
+    case 'i': // input
+        if (command == 'p')
+            return "i p";
+        if (command == 'l')
+            return "i l";
+        if (command == 'e')
+            return "i e";
+        if (command == 'r')
+            return "i r";
+        break;
+    case 'k': // keyboard
+        if (command == 'l')
+            return "k l";
+        break;
+    case 'd': // device
+        if (command == 'l')
+            return "d l";
+        if (command == 'c')
+            return "d c";
+        break;
+    case 's': { // subscribe, no events subscribes to all of them
+        std::string message = "s";
+        for (size_t i = 1; i != args.size(); ++i) {
+            if (args[i].empty() ||
+                std::string("fwto").find(args[i][0]) == std::string::npos)
+                return "";
+
+            message += " " + std::string(1, args[i][0]);
+        }
+        return message;
+    }
+    case 'p': // state page
+        if (!command || command == 'w')
+            return "p";
+        break;
+    default:
+        break;
     }
 
-    std::string group = argv[1];
+    return "";
+}
 
-    // group help
-    if (group[0] == 'h') {
-        print_usage();
-        return 0;
+// connect to the ipc socket, returns the file descriptor or exits
+int connect_ipc() {
+    // create socket
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        print_err("Failed to create socket");
+        exit(1);
     }
 
-    std::string message;
+    // connect to ipc socket
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    const char *path = getenv("AWMSOCK");
+    strncpy(addr.sun_path, path ? path : "/tmp/awm.sock",
+            sizeof(addr.sun_path) - 1);
 
-    // group exit
-    if (group[0] == 'e')
-        message = "exit";
+    if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                sizeof(struct sockaddr_un))) {
+        print_err("Failed to connect to IPC socket (is awm ipc running?)");
+        exit(2);
+    }
 
-    // group output
-    if (group[0] == 'o') {
-        if (argc == 2) {
-            print_usage();
-            return 1;
+    return fd;
+}
+
+// write a whole buffer, returns false on failure
+bool write_all(const int fd, const std::string &data) {
+    size_t written = 0;
+    while (written != data.size()) {
+        const ssize_t len = send(fd, data.data() + written,
+                                 data.size() - written, MSG_NOSIGNAL);
+        if (len == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
         }
+        written += len;
+    }
+
+    return true;
+}
 
-        if (argv[2][0] == 'l')
-            message = "o l";
-        else if (argv[2][0] == 'm')
-            message = "o m";
+// block until a message is received, returns false on EOF or failure
+bool read_message(const int fd, std::string &buffer, uint32_t *type,
+                  std::string *payload) {
+    char chunk[4096];
+
+    while (true) {
+        const int status = ipc_parse(buffer, type, payload);
+        if (status == 1)
+            return true;
+        if (status == -1)
+            return false;
+
+        const ssize_t len = read(fd, chunk, sizeof(chunk));
+        if (len == -1 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            return false;
+
+        buffer.append(chunk, len);
     }
+}
 
-    // group workspace
-    if (group[0] == 'w') {
-        if (argc == 2) {
-            print_usage();
-            return 1;
-        }
+// block until the reply to a state page request is received along with the
+// memfd and eventfd it carries, returns false on EOF or failure
+bool read_state_fds(const int fd, std::string &buffer, int *memfd,
+                    int *eventfd) {
+    char chunk[4096];
+    char control[CMSG_SPACE(2 * sizeof(int))];
+
+    *memfd = *eventfd = -1;
+
+    while (true) {
+        uint32_t type;
+        std::string payload;
+        const int status = ipc_parse(buffer, &type, &payload);
+        if (status == 1 && type == IPC_MESSAGE_REPLY)
+            return *memfd != -1 && *eventfd != -1;
+        if (status == 1)
+            continue;
+        if (status == -1)
+            return false;
+
+        iovec iov{chunk, sizeof(chunk)};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        const ssize_t len = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        if (len == -1 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            return false;
+
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+             cmsg = CMSG_NXTHDR(&msg, cmsg))
+            if (cmsg->cmsg_level == SOL_SOCKET &&
+                cmsg->cmsg_type == SCM_RIGHTS &&
+                cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int))) {
+                int fds[2];
+                memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+                *memfd = fds[0];
+                *eventfd = fds[1];
+            }
 
-        if (argv[2][0] == 'l')
-            message = "w l";
+        buffer.append(chunk, len);
     }
+}
+
+// convert a nul terminated fixed size buffer to a string
+std::string fixed_string(const char *buffer, const size_t size) {
+    return std::string(buffer, strnlen(buffer, size));
+}
+
+// read a consistent copy of the state page
+json read_state(const IPCState *state) {
+    while (true) {
+        // odd while the compositor is writing
+        const uint32_t sequence =
+            state->sequence.load(std::memory_order_acquire);
+        if (sequence & 1)
+            continue;
+
+        json outputs = json::object();
+        json workspaces = json::array();
+        json toplevels = json::object();
+
+        const uint32_t output_count =
+            std::min<uint32_t>(state->output_count, IPC_STATE_MAX_OUTPUTS);
+        const uint32_t workspace_count = std::min<uint32_t>(
+            state->workspace_count, IPC_STATE_MAX_WORKSPACES);
+        const uint32_t toplevel_count =
+            std::min<uint32_t>(state->toplevel_count, IPC_STATE_MAX_TOPLEVELS);
+
+        for (uint32_t i = 0; i != output_count; ++i) {
+            const IPCStateOutput &o = state->outputs[i];
+            outputs[fixed_string(o.name, sizeof(o.name))] = {
+                {"x", o.x},
+                {"y", o.y},
+                {"width", o.width},
+                {"height", o.height},
+                {"refresh", o.refresh / 1000.0},
+                {"scale", o.scale},
+                {"transform", o.transform},
+                {"adaptive", static_cast<bool>(o.adaptive)},
+                {"enabled", static_cast<bool>(o.enabled)},
+                {"focused", static_cast<bool>(o.focused)},
+                {"workspace", o.workspace},
+            };
+        }
+
+        for (uint32_t i = 0; i != workspace_count; ++i) {
+            const IPCStateWorkspace &w = state->workspaces[i];
+            workspaces.push_back({
+                {"output", w.output < output_count
+                               ? fixed_string(state->outputs[w.output].name,
+                                              IPC_STATE_NAME_SIZE)
+                               : ""},
+                {"number", w.number},
+                {"focused", static_cast<bool>(w.focused)},
+            });
+        }
+
+        for (uint32_t i = 0; i != toplevel_count; ++i) {
+            const IPCStateToplevel &t = state->toplevels[i];
 
-    // group toplevel
-    if (group[0] == 't') {
-        if (argc == 2) {
-            print_usage();
-            return 1;
+            toplevels[std::to_string(t.id)] = {
+                {"title", fixed_string(t.title, sizeof(t.title))},
+                {"workspace", t.workspace < workspace_count
+                                  ? state->workspaces[t.workspace].number
+                                  : 0},
+                {"x", t.x},
+                {"y", t.y},
+                {"width", t.width},
+                {"height", t.height},
+                {"focused", static_cast<bool>(t.focused)},
+                {"hidden", static_cast<bool>(t.hidden)},
+                {"maximized", static_cast<bool>(t.maximized)},
+                {"fullscreen", static_cast<bool>(t.fullscreen)},
+                {"xwayland", static_cast<bool>(t.xwayland)},
+            };
         }
 
-        if (argv[2][0] == 'l')
-            message = "t l";
+        // retry if the compositor wrote meanwhile
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (state->sequence.load(std::memory_order_relaxed) != sequence)
+            continue;
+
+        return {{"outputs", outputs},
+                {"workspaces", workspaces},
+                {"toplevels", toplevels}};
+    }
+}
+
+// map the state page and print it, again on every change when watching
+int page(const int fd, const bool watch) {
+    if (!write_all(fd, ipc_frame(IPC_MESSAGE_COMMAND, "p"))) {
+        print_err("Failed to write to IPC socket");
+        return 3;
     }
 
-    // group keyboard
-    if (group[0] == 'k') {
-        if (argc == 2) {
-            print_usage();
-            return 1;
+    std::string buffer;
+    int memfd, eventfd;
+    if (!read_state_fds(fd, buffer, &memfd, &eventfd)) {
+        print_err("Failed to receive state page from IPC socket");
+        return 4;
+    }
+
+    void *page =
+        mmap(nullptr, sizeof(IPCState), PROT_READ, MAP_SHARED, memfd, 0);
+    close(memfd);
+
+    if (page == MAP_FAILED) {
+        print_err("Failed to map state page");
+        return 4;
+    }
+
+    const IPCState *state = static_cast<const IPCState *>(page);
+    if (state->magic != IPC_STATE_MAGIC ||
+        state->version != IPC_STATE_VERSION) {
+        print_err("Unsupported state page version");
+        return 4;
+    }
+
+    if (!watch) {
+        std::cout << read_state(state).dump(4) << std::endl;
+        return 0;
+    }
+
+    // the eventfd is signalled for as long as the connection stays open
+    std::cout << read_state(state).dump() << std::endl;
+    while (true) {
+        pollfd fds[2] = {{eventfd, POLLIN, 0}, {fd, POLLIN, 0}};
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            print_err("Failed to poll");
+            return 4;
         }
 
-        if (argv[2][0] == 'l')
-            message = "k l";
+        // compositor went away
+        if (fds[1].revents)
+            break;
+
+        eventfd_t value;
+        if (eventfd_read(eventfd, &value) == 0)
+            std::cout << read_state(state).dump() << std::endl;
     }
 
-    // group device
-    if (group[0] == 'd') {
-        if (argc == 2) {
-            print_usage();
-            return 1;
+    close(eventfd);
+    close(fd);
+    return 0;
+}
+
+// print a reply on a single line, empty replies print an empty line
+void print_line(const std::string &payload) {
+    if (payload.empty())
+        std::cout << std::endl;
+    else
+        std::cout << json::parse(payload).dump() << std::endl;
+}
+
+// send every query read from stdin over one connection, replies are read
+// while queries are still being sent so neither side blocks the other,
+// returns 5 if any query was invalid, got no reply or failed
+int batch(const int fd) {
+    // outgoing messages and incoming data
+    std::string out, in, input;
+
+    // one entry per input line in order, either waiting for a reply or
+    // holding an error for an invalid query
+    struct Line {
+        bool ready;
+        std::string query;
+        std::string text;
+        bool error;
+    };
+    std::deque<Line> lines;
+    bool failed = false;
+
+    bool input_done = false;
+    size_t waiting = 0;
+
+    while (!input_done || waiting) {
+        pollfd fds[2] = {
+            {fd, static_cast<short>(POLLIN | (out.empty() ? 0 : POLLOUT)), 0},
+            {input_done ? -1 : STDIN_FILENO, POLLIN, 0},
+        };
+
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            print_err("Failed to poll");
+            return 4;
+        }
+
+        // read queries
+        if (fds[1].revents & (POLLIN | POLLHUP)) {
+            char chunk[4096];
+            const ssize_t len = read(STDIN_FILENO, chunk, sizeof(chunk));
+
+            if (len <= 0) {
+                input_done = true;
+
+                // treat a missing trailing newline as the end of a line
+                if (!input.empty())
+                    input += '\n';
+            } else
+                input.append(chunk, len);
+
+            size_t end;
+            while ((end = input.find('\n')) != std::string::npos) {
+                std::string line = input.substr(0, end);
+                input.erase(0, end + 1);
+
+                std::vector<std::string> args;
+                std::stringstream ss(line);
+                std::string arg;
+                while (ss >> arg)
+                    args.push_back(arg);
+
+                // skip blank lines
+                if (args.empty())
+                    continue;
+
+                const std::string message = parse_query(args);
+                if (message.empty()) {
+                    lines.push_back({true, line, "", true});
+                    continue;
+                }
+
+                out += ipc_frame(IPC_MESSAGE_COMMAND, message);
+                lines.push_back({false, line, "", false});
+                ++waiting;
+            }
         }
 
-        if (argv[2][0] == 'l')
-            message = "d l";
-        else if (argv[2][0] == 'c')
-            message = "d c";
+        // send queries
+        if (fds[0].revents & POLLOUT) {
+            const ssize_t len =
+                send(fd, out.data(), out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (len == -1 && errno != EAGAIN && errno != EINTR) {
+                print_err("Failed to write to IPC socket");
+                return 3;
+            }
+            if (len > 0)
+                out.erase(0, len);
+        }
+
+        // read replies
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            char chunk[4096];
+            const ssize_t len = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+
+            if (len == 0 || (len == -1 && errno != EAGAIN && errno != EINTR)) {
+                print_err("Failed to read from IPC socket");
+                return 4;
+            }
+
+            if (len > 0)
+                in.append(chunk, len);
+
+            uint32_t type;
+            std::string payload;
+            int status;
+            while ((status = ipc_parse(in, &type, &payload)) == 1) {
+                // events of a subscription are not part of the batch
+                if (type != IPC_MESSAGE_REPLY)
+                    continue;
+
+                // fill the first line waiting for a reply
+                for (Line &line : lines)
+                    if (!line.ready) {
+                        line.ready = true;
+                        line.text = payload;
+                        break;
+                    }
+                --waiting;
+            }
+
+            if (status == -1) {
+                print_err("Received malformed message from IPC socket");
+                return 4;
+            }
+        }
+
+        // print in input order
+        while (!lines.empty() && lines.front().ready) {
+            const Line &line = lines.front();
+
+            if (line.error) {
+                print_err("Query '%s' did not match command",
+                          line.query.c_str());
+                failed = true;
+            } else if (line.text.empty()) {
+                print_err("No reply to query '%s'", line.query.c_str());
+                failed = true;
+            } else {
+                const json reply = json::parse(line.text);
+                std::cout << reply.dump() << std::endl;
+
+                // commands report failure in their reply
+                if (reply.is_object() && reply.contains("success") &&
+                    reply["success"] == false)
+                    failed = true;
+            }
+
+            lines.pop_front();
+        }
     }
 
+    // print errors after the last reply
+    for (const Line &line : lines) {
+        print_err("Query '%s' did not match command", line.query.c_str());
+        failed = true;
+    }
+
+    close(fd);
+    return failed ? 5 : 0;
+}
+
+int main(int argc, char **argv) {
+    // print usage
+    if (argc == 1) {
+        print_usage();
+        return 0;
+    }
+
+    std::string group = argv[1];
+
+    // group help
+    if (group[0] == 'h') {
+        print_usage();
+        return 0;
+    }
+
+    // group batch
+    if (group[0] == 'b')
+        return batch(connect_ipc());
+
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    const std::string message = parse_query(args);
+
     // invalid group or command
-    if (message == "") {
+    if (message.empty()) {
         std::string query = argv[1];
         for (int i = 2; i < argc; i++)
             query += " " + std::string(argv[i]);
@@ -123,45 +628,39 @@ int main(int argc, char **argv) {
         return 0;
     }
 
-    // create socket
-    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (fd == -1) {
-        print_err("Failed to create socket");
-        return 1;
-    }
+    int fd = connect_ipc();
 
-    // connect to ipc socket
-    sockaddr_un addr{};
-    addr.sun_family = AF_UNIX;
-    strncpy(addr.sun_path, "/tmp/awm.sock", sizeof(addr.sun_path) - 1);
-
-    if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
-                sizeof(struct sockaddr_un))) {
-        print_err("Failed to connect to IPC socket (is awm ipc running?)");
-        return 2;
-    }
+    // group page
+    if (group[0] == 'p')
+        return page(fd, args.size() > 1 && args[1][0] == 'w');
 
     // write to ipc socket
-    if (write(fd, message.c_str(), strlen(message.c_str())) == -1) {
+    if (!write_all(fd, ipc_frame(IPC_MESSAGE_COMMAND, message))) {
         print_err("Failed to write to IPC socket");
         return 3;
     }
 
-    // read response from ipc socket
-    std::string response;
-    char buffer[1024];
-    int len;
-    while ((len = read(fd, buffer, sizeof(buffer))) > 0)
-        response.append(buffer, len);
+    std::string buffer, payload;
+    uint32_t type;
+
+    // print events as they arrive, one json object per line
+    if (group[0] == 's') {
+        while (read_message(fd, buffer, &type, &payload))
+            print_line(payload);
 
-    if (len == -1) {
+        close(fd);
+        return 0;
+    }
+
+    // read response from ipc socket
+    if (!read_message(fd, buffer, &type, &payload)) {
         print_err("Failed to read from IPC socket");
         return 4;
     }
 
-    if (!response.empty()) {
+    if (!payload.empty()) {
         // parse response json
-        json response_json = json::parse(response);
+        json response_json = json::parse(payload);
 
         // print response
         std::cout << response_json.dump(4) << std::endl;
@@ -0,0 +1,542 @@
+// IPC load generator, run with `meson test --benchmark`
+//
+// starts awm on the headless backend with the pixman renderer, maps
+// toplevels from a wayland client, then drives concurrent IPC clients while
+// one toplevel redraws every frame to measure compositor frame time jitter
+
+#include "IPCProtocol.h"
+#include "xdg-shell-client-protocol.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <poll.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <wayland-client.h>
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+// side of the square buffer every toplevel shows
+constexpr int BUFFER_SIZE = 64;
+
+struct Options {
+    std::string awm;
+    int toplevels{50};
+    int clients{8};
+    int seconds{5};
+};
+
+struct Window {
+    struct Client *client{nullptr};
+    wl_surface *surface{nullptr};
+    xdg_surface *shell_surface{nullptr};
+    xdg_toplevel *toplevel{nullptr};
+    bool configured{false};
+};
+
+// wayland client mapping the dummy toplevels
+struct Client {
+    wl_display *display{nullptr};
+    wl_registry *registry{nullptr};
+    wl_compositor *compositor{nullptr};
+    wl_shm *shm{nullptr};
+    xdg_wm_base *wm_base{nullptr};
+    wl_buffer *buffer{nullptr};
+    std::vector<Window *> windows;
+
+    // frame callback timestamps of the first toplevel
+    std::mutex frames_mutex;
+    std::vector<Clock::time_point> frames;
+    bool recording{false};
+};
+
+void print_err(const char *msg) { fprintf(stderr, "ERROR: %s\n", msg); }
+
+// percentile of sorted samples
+template <typename T> T percentile(const std::vector<T> &sorted, double p) {
+    if (sorted.empty())
+        return T{};
+
+    const size_t i = std::min(sorted.size() - 1,
+                              static_cast<size_t>(p * sorted.size()));
+    return sorted[i];
+}
+
+// start awm, returns its pid or -1
+pid_t start_awm(const Options &options, const std::string &dir) {
+    // config with the pixman renderer and ipc enabled
+    const std::string config = dir + "/config.toml";
+    FILE *file = fopen(config.c_str(), "w");
+    if (!file)
+        return -1;
+
+    fprintf(file, "[startup]\nrenderer = \"pixman\"\nipc = true\n");
+    fclose(file);
+
+    // report the wayland display once it is up
+    const std::string startup =
+        "echo \"$WAYLAND_DISPLAY\" > " + dir + "/display.tmp && mv " + dir +
+        "/display.tmp " + dir + "/display";
+
+    const pid_t pid = fork();
+    if (pid == 0) {
+        setenv("WLR_BACKENDS", "headless", true);
+        setenv("WLR_HEADLESS_OUTPUTS", "1", true);
+        setenv("WLR_LIBINPUT_NO_DEVICES", "1", true);
+
+        // keep the compositor log out of the results
+        if (!freopen((dir + "/awm.log").c_str(), "w", stderr))
+            _exit(127);
+
+        execl(options.awm.c_str(), options.awm.c_str(), "-c", config.c_str(),
+              "-s", startup.c_str(), nullptr);
+        _exit(127);
+    }
+
+    return pid;
+}
+
+// wait for a file to appear, returns false on timeout
+bool wait_for(const std::string &path, const pid_t awm) {
+    for (int i = 0; i != 1000; ++i) {
+        if (!access(path.c_str(), F_OK))
+            return true;
+
+        // awm died
+        if (waitpid(awm, nullptr, WNOHANG) == awm)
+            return false;
+
+        usleep(10 * 1000);
+    }
+
+    return false;
+}
+
+// connect to the ipc socket, returns -1 on failure
+int connect_ipc(const std::string &path) {
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// send a query and block until its reply arrives
+bool query(const int fd, std::string &buffer, const std::string &message,
+           std::string *reply) {
+    const std::string frame = ipc_frame(IPC_MESSAGE_COMMAND, message);
+
+    size_t written = 0;
+    while (written != frame.size()) {
+        const ssize_t len = send(fd, frame.data() + written,
+                                 frame.size() - written, MSG_NOSIGNAL);
+        if (len <= 0)
+            return false;
+        written += len;
+    }
+
+    char chunk[64 * 1024];
+    uint32_t type;
+    int status;
+    while (!(status = ipc_parse(buffer, &type, reply))) {
+        const ssize_t len = read(fd, chunk, sizeof(chunk));
+        if (len <= 0)
+            return false;
+        buffer.append(chunk, len);
+    }
+
+    return status == 1;
+}
+
+// create the buffer shared by every toplevel
+wl_buffer *create_buffer(wl_shm *shm) {
+    const int stride = BUFFER_SIZE * 4;
+    const int size = stride * BUFFER_SIZE;
+
+    const int fd = memfd_create("ipc-bench", MFD_CLOEXEC);
+    if (fd == -1 || ftruncate(fd, size) == -1)
+        return nullptr;
+
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+
+    // opaque grey
+    std::fill_n(static_cast<uint32_t *>(data), size / 4, 0xff808080);
+    munmap(data, size);
+
+    wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
+    wl_buffer *buffer = wl_shm_pool_create_buffer(
+        pool, 0, BUFFER_SIZE, BUFFER_SIZE, stride, WL_SHM_FORMAT_ARGB8888);
+    wl_shm_pool_destroy(pool);
+    close(fd);
+
+    return buffer;
+}
+
+// redraw the first toplevel every frame
+void request_frame(Window *window) {
+    static const wl_callback_listener listener = {
+        [](void *data, wl_callback *callback,
+           [[maybe_unused]] uint32_t time) {
+            Window *window = static_cast<Window *>(data);
+            Client *client = window->client;
+            wl_callback_destroy(callback);
+
+            {
+                std::lock_guard<std::mutex> lock(client->frames_mutex);
+                if (client->recording)
+                    client->frames.push_back(Clock::now());
+            }
+
+            request_frame(window);
+        },
+    };
+
+    wl_callback *callback = wl_surface_frame(window->surface);
+    wl_callback_add_listener(callback, &listener, window);
+
+    wl_surface_attach(window->surface, window->client->buffer, 0, 0);
+    wl_surface_damage_buffer(window->surface, 0, 0, BUFFER_SIZE, BUFFER_SIZE);
+    wl_surface_commit(window->surface);
+}
+
+// connect to awm and map the toplevels, returns false on failure
+bool map_toplevels(Client &client, const std::string &display,
+                   const int count) {
+    if (!((client.display = wl_display_connect(display.c_str())))) {
+        print_err("Failed to connect to the wayland display");
+        return false;
+    }
+
+    static const xdg_wm_base_listener wm_base_listener = {
+        []([[maybe_unused]] void *data, xdg_wm_base *wm_base,
+           uint32_t serial) { xdg_wm_base_pong(wm_base, serial); },
+    };
+
+    static const wl_registry_listener registry_listener = {
+        [](void *data, wl_registry *registry, uint32_t name,
+           const char *interface, [[maybe_unused]] uint32_t version) {
+            Client *client = static_cast<Client *>(data);
+
+            if (!strcmp(interface, wl_compositor_interface.name))
+                client->compositor = static_cast<wl_compositor *>(
+                    wl_registry_bind(registry, name, &wl_compositor_interface,
+                                     4));
+            else if (!strcmp(interface, wl_shm_interface.name))
+                client->shm = static_cast<wl_shm *>(
+                    wl_registry_bind(registry, name, &wl_shm_interface, 1));
+            else if (!strcmp(interface, xdg_wm_base_interface.name)) {
+                client->wm_base = static_cast<xdg_wm_base *>(wl_registry_bind(
+                    registry, name, &xdg_wm_base_interface, 1));
+                xdg_wm_base_add_listener(client->wm_base, &wm_base_listener,
+                                         nullptr);
+            }
+        },
+        []([[maybe_unused]] void *data,
+           [[maybe_unused]] wl_registry *registry,
+           [[maybe_unused]] uint32_t name) {},
+    };
+
+    client.registry = wl_display_get_registry(client.display);
+    wl_registry_add_listener(client.registry, &registry_listener, &client);
+    wl_display_roundtrip(client.display);
+
+    if (!client.compositor || !client.shm || !client.wm_base) {
+        print_err("Missing wayland globals");
+        return false;
+    }
+
+    if (!((client.buffer = create_buffer(client.shm)))) {
+        print_err("Failed to create buffer");
+        return false;
+    }
+
+    static const xdg_surface_listener surface_listener = {
+        [](void *data, xdg_surface *xdg_surface, uint32_t serial) {
+            Window *window = static_cast<Window *>(data);
+            xdg_surface_ack_configure(xdg_surface, serial);
+
+            // map on the first configure
+            if (!window->configured) {
+                window->configured = true;
+                wl_surface_attach(window->surface, window->client->buffer, 0,
+                                  0);
+            }
+
+            wl_surface_commit(window->surface);
+        },
+    };
+
+    for (int i = 0; i != count; ++i) {
+        Window *window = new Window;
+        window->client = &client;
+        window->surface = wl_compositor_create_surface(client.compositor);
+        window->shell_surface =
+            xdg_wm_base_get_xdg_surface(client.wm_base, window->surface);
+        xdg_surface_add_listener(window->shell_surface, &surface_listener,
+                                 window);
+        window->toplevel = xdg_surface_get_toplevel(window->shell_surface);
+        xdg_toplevel_set_title(window->toplevel,
+                               ("ipc-bench " + std::to_string(i)).c_str());
+        wl_surface_commit(window->surface);
+
+        client.windows.push_back(window);
+    }
+
+    // wait for every toplevel to be configured and mapped
+    while (std::any_of(client.windows.begin(), client.windows.end(),
+                       [](const Window *w) { return !w->configured; }))
+        if (wl_display_roundtrip(client.display) == -1) {
+            print_err("Lost the wayland connection");
+            return false;
+        }
+
+    return true;
+}
+
+// block until awm lists the expected number of toplevels
+bool wait_mapped(const std::string &socket, const int count) {
+    const int fd = connect_ipc(socket);
+    if (fd == -1)
+        return false;
+
+    std::string buffer, reply;
+    for (int i = 0; i != 1000; ++i) {
+        if (!query(fd, buffer, "t l title", &reply))
+            break;
+
+        if (json::parse(reply, nullptr, false).size() >=
+            static_cast<size_t>(count)) {
+            close(fd);
+            return true;
+        }
+
+        usleep(10 * 1000);
+    }
+
+    close(fd);
+    return false;
+}
+
+// record frame intervals for a while, in milliseconds
+std::vector<double> record_frames(Client &client, const double seconds) {
+    {
+        std::lock_guard<std::mutex> lock(client.frames_mutex);
+        client.frames.clear();
+        client.recording = true;
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+
+    std::lock_guard<std::mutex> lock(client.frames_mutex);
+    client.recording = false;
+
+    std::vector<double> intervals;
+    for (size_t i = 1; i < client.frames.size(); ++i)
+        intervals.push_back(std::chrono::duration<double, std::milli>(
+                                client.frames[i] - client.frames[i - 1])
+                                .count());
+
+    return intervals;
+}
+
+void print_frames(const char *name, std::vector<double> intervals) {
+    std::sort(intervals.begin(), intervals.end());
+
+    double mean = 0, variance = 0;
+    for (const double interval : intervals)
+        mean += interval;
+    mean /= std::max<size_t>(1, intervals.size());
+
+    for (const double interval : intervals)
+        variance += (interval - mean) * (interval - mean);
+    variance /= std::max<size_t>(1, intervals.size());
+
+    printf("frame interval %-5s %6zu frames  p50 %7.3f ms  p99 %7.3f ms  "
+           "max %7.3f ms  jitter %6.3f ms\n",
+           name, intervals.size(), percentile(intervals, 0.5),
+           percentile(intervals, 0.99),
+           intervals.empty() ? 0.0 : intervals.back(), std::sqrt(variance));
+}
+
+int run(const Options &options, const std::string &dir, const pid_t awm) {
+    const std::string socket = dir + "/awm.sock";
+
+    if (!wait_for(dir + "/display", awm) || !wait_for(socket, awm)) {
+        print_err("awm did not start, see awm.log");
+        return 1;
+    }
+
+    // read the display name
+    char display[64]{};
+    FILE *file = fopen((dir + "/display").c_str(), "r");
+    if (!file || !fgets(display, sizeof(display), file)) {
+        print_err("Failed to read the wayland display");
+        return 1;
+    }
+    fclose(file);
+    display[strcspn(display, "\n")] = '\0';
+
+    Client client;
+    if (!map_toplevels(client, display, options.toplevels))
+        return 1;
+
+    if (!wait_mapped(socket, options.toplevels)) {
+        print_err("Toplevels did not map");
+        return 1;
+    }
+
+    // keep the first toplevel redrawing on its own thread
+    request_frame(client.windows.front());
+    wl_display_flush(client.display);
+
+    std::atomic<bool> running{true};
+    std::thread wayland([&]() {
+        while (running && wl_display_dispatch(client.display) != -1)
+            ;
+    });
+
+    // frame times without load
+    const std::vector<double> idle = record_frames(client, 1.0);
+
+    // every client cycles through the listings
+    static const char *queries[] = {"t l", "w l", "o l"};
+    std::atomic<bool> loading{true};
+    std::atomic<bool> failed{false};
+    std::vector<std::vector<double>> latencies(options.clients);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i != options.clients; ++i)
+        threads.emplace_back([&, i]() {
+            const int fd = connect_ipc(socket);
+            if (fd == -1) {
+                failed = true;
+                return;
+            }
+
+            std::string buffer, reply;
+            for (size_t n = i; loading; ++n) {
+                const Clock::time_point start = Clock::now();
+                if (!query(fd, buffer, queries[n % 3], &reply)) {
+                    failed = true;
+                    break;
+                }
+
+                const std::chrono::duration<double, std::micro> latency =
+                    Clock::now() - start;
+                latencies[i].push_back(latency.count());
+            }
+
+            close(fd);
+        });
+
+    const Clock::time_point start = Clock::now();
+    const std::vector<double> loaded = record_frames(client, options.seconds);
+    loading = false;
+
+    for (std::thread &thread : threads)
+        thread.join();
+
+    const double elapsed =
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    // the redrawing toplevel wakes the wayland thread every frame
+    running = false;
+    wayland.join();
+
+    if (failed) {
+        print_err("An IPC client failed");
+        return 1;
+    }
+
+    std::vector<double> all;
+    for (const std::vector<double> &samples : latencies)
+        all.insert(all.end(), samples.begin(), samples.end());
+    std::sort(all.begin(), all.end());
+
+    printf("toplevels %d  clients %d  duration %.1f s\n", options.toplevels,
+           options.clients, elapsed);
+    printf("queries %zu  %.0f qps\n", all.size(), all.size() / elapsed);
+    printf("latency p50 %.1f us  p99 %.1f us  p999 %.1f us  max %.1f us\n",
+           percentile(all, 0.5), percentile(all, 0.99),
+           percentile(all, 0.999), all.empty() ? 0.0 : all.back());
+    print_frames("idle", idle);
+    print_frames("load", loaded);
+
+    wl_display_disconnect(client.display);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+
+    // usage: ipc_bench <awm> [toplevels] [clients] [seconds]
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <awm> [toplevels] [clients] [seconds]\n",
+                argv[0]);
+        return 1;
+    }
+
+    options.awm = argv[1];
+    if (argc > 2)
+        options.toplevels = std::max(1, atoi(argv[2]));
+    if (argc > 3)
+        options.clients = std::max(1, atoi(argv[3]));
+    if (argc > 4)
+        options.seconds = std::max(1, atoi(argv[4]));
+
+    // private runtime dir for the wayland and ipc sockets
+    char dir[] = "/tmp/awm-bench-XXXXXX";
+    if (!mkdtemp(dir)) {
+        print_err("Failed to create runtime directory");
+        return 1;
+    }
+
+    setenv("XDG_RUNTIME_DIR", dir, true);
+    setenv("AWMSOCK", (std::string(dir) + "/awm.sock").c_str(), true);
+
+    const pid_t awm = start_awm(options, dir);
+    if (awm == -1) {
+        print_err("Failed to start awm");
+        return 1;
+    }
+
+    const int status = run(options, dir, awm);
+
+    // stop awm
+    kill(awm, SIGTERM);
+    waitpid(awm, nullptr, 0);
+
+    if (!status)
+        std::filesystem::remove_all(dir);
+    else
+        fprintf(stderr, "kept %s for inspection\n", dir);
+
+    return status;
+}
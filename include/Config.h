@@ -3,6 +3,7 @@
 #include "wlr.h"
 #include <filesystem>
 #include <libinput.h>
+#include <unordered_map>
 #include <vector>
 
 struct Bind {
@@ -14,6 +15,47 @@ struct Bind {
     }
 };
 
+// what a bind does once pressed
+enum BindAction {
+    BIND_COMMAND,
+    BIND_EXIT,
+    BIND_WINDOW_FULLSCREEN,
+    BIND_WINDOW_PREVIOUS,
+    BIND_WINDOW_NEXT,
+    BIND_WINDOW_MOVE,
+    BIND_WINDOW_UP,
+    BIND_WINDOW_DOWN,
+    BIND_WINDOW_LEFT,
+    BIND_WINDOW_RIGHT,
+    BIND_WINDOW_CLOSE,
+    BIND_WINDOW_SWAP_UP,
+    BIND_WINDOW_SWAP_DOWN,
+    BIND_WINDOW_SWAP_LEFT,
+    BIND_WINDOW_SWAP_RIGHT,
+    BIND_WORKSPACE_TILE,
+    BIND_WORKSPACE_OPEN,
+    BIND_WORKSPACE_WINDOW_TO,
+};
+
+struct CompiledBind {
+    BindAction action;
+
+    // index into commands or workspace number
+    uint32_t argument{0};
+
+    bool operator==(const CompiledBind other) const {
+        return action == other.action && argument == other.argument;
+    }
+};
+
+// key of a bind in the bind table
+inline uint64_t bind_key(const uint32_t modifiers, const xkb_keysym_t sym) {
+    return static_cast<uint64_t>(modifiers) << 32 | sym;
+}
+
+// render_delay of an output picked from its render times and presentation
+constexpr int32_t RENDER_DELAY_AUTO = -1;
+
 struct OutputConfig {
     std::string name;
     bool enabled{true};
@@ -24,6 +66,26 @@ struct OutputConfig {
     double scale{1.0};
     bool adaptive_sync{false};
 
+    // ms to wait after the frame event before rendering, or
+    // RENDER_DELAY_AUTO
+    int32_t render_delay{0};
+
+    // send frame callbacks late enough that clients finish just in time
+    bool frame_delay{false};
+
+    // let fullscreen toplevels asking for async presentation tear
+    bool allow_tearing{false};
+
+    // compares the state committed by Output::apply_config only, frame
+    // scheduling options are assigned without a commit
+    bool operator==(const OutputConfig &other) const {
+        return name == other.name && enabled == other.enabled &&
+               width == other.width && height == other.height &&
+               x == other.x && y == other.y && refresh == other.refresh &&
+               transform == other.transform && scale == other.scale &&
+               adaptive_sync == other.adaptive_sync;
+    }
+
     OutputConfig() = default;
 
     explicit OutputConfig(const wlr_output_configuration_head_v1 *config_head) {
@@ -47,9 +109,12 @@ struct OutputConfig {
     }
 };
 
+// a parsed config file, never modified once active. Reloads parse a new
+// Config and apply the sections that differ from the active one.
 struct Config {
     std::string path;
     std::filesystem::file_time_type last_write_time;
+    bool loaded{false};
 
     std::string renderer{"auto"};
     std::vector<std::string> startup_commands;
@@ -57,6 +122,7 @@ struct Config {
     std::vector<std::pair<std::string, std::string>> startup_env;
     std::vector<std::pair<Bind, std::string>> commands;
     bool ipc{true};
+    bool i3_ipc{false};
 
     // keyboard
     std::string keyboard_layout{"us"};
@@ -66,7 +132,7 @@ struct Config {
     int64_t repeat_rate{25}, repeat_delay{600};
 
     // cursor
-    struct {
+    struct CursorConfig {
         libinput_config_tap_state tap_to_click{LIBINPUT_CONFIG_TAP_ENABLED};
         libinput_config_drag_state tap_and_drag{LIBINPUT_CONFIG_DRAG_ENABLED};
         libinput_config_drag_lock_state drag_lock{
@@ -86,6 +152,26 @@ struct Config {
         libinput_config_accel_profile profile{
             LIBINPUT_CONFIG_ACCEL_PROFILE_ADAPTIVE};
         double accel_speed{0.0};
+
+        // hit-test and send absolute motion once per frame
+        bool coalesce_motion{false};
+
+        bool operator==(const CursorConfig &other) const {
+            return tap_to_click == other.tap_to_click &&
+                   tap_and_drag == other.tap_and_drag &&
+                   drag_lock == other.drag_lock &&
+                   tap_button_map == other.tap_button_map &&
+                   natural_scroll == other.natural_scroll &&
+                   disable_while_typing == other.disable_while_typing &&
+                   left_handed == other.left_handed &&
+                   middle_emulation == other.middle_emulation &&
+                   scroll_method == other.scroll_method &&
+                   click_method == other.click_method &&
+                   event_mode == other.event_mode &&
+                   profile == other.profile &&
+                   accel_speed == other.accel_speed &&
+                   coalesce_motion == other.coalesce_motion;
+        }
     } cursor;
 
     // exit compositor
@@ -141,11 +227,16 @@ struct Config {
 
     std::vector<OutputConfig *> outputs;
 
+    // every bind and command by modifiers and keysym, see bind_key
+    std::unordered_map<uint64_t, CompiledBind> bind_table;
+
     Config();
     explicit Config(const std::string &path);
-    ~Config() = default;
+    Config(const Config &) = delete;
+    ~Config();
 
     bool load();
+    void compile_binds();
 
-    void update(const struct Server *server);
+    OutputConfig *output_config(const std::string &name) const;
 };
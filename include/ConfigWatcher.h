@@ -0,0 +1,25 @@
+#include "wlr.h"
+#include <string>
+
+// reloads the config when its file changes, driven by inotify on the event
+// loop so nothing wakes up while the file is left alone
+struct ConfigWatcher {
+    struct Server *server;
+
+    int fd;
+    wl_event_source *event_source{nullptr};
+    wl_event_source *debounce{nullptr};
+
+    // directory watch catches editors saving by rename, file watch catches
+    // writes through a symlink
+    int directory_watch{-1};
+    int file_watch{-1};
+    std::string directory;
+    std::string name;
+
+    ConfigWatcher(Server *server, const std::string &path);
+    ~ConfigWatcher();
+
+    void watch_file();
+    void handle_events();
+};
@@ -28,7 +28,21 @@ struct Cursor {
 
     wl_listener request_set_shape;
 
-    wlr_pointer_constraint_v1 *active_constraint{nullptr};
+    struct PointerConstraint *active_constraint{nullptr};
+
+    // a lock constraint is active, motion only produces relative events
+    bool locked{false};
+
+    // motion events received and those handled by the locked fast path
+    uint64_t motion_events{0};
+    uint64_t locked_motion_events{0};
+
+    // motion waiting for the next output frame with coalesce_motion
+    bool motion_pending{false};
+    uint32_t motion_time{0};
+
+    // latency stats of the device that moved the pointer last
+    struct InputStats *motion_stats{nullptr};
 
     Cursor(Server *server);
     ~Cursor();
@@ -36,9 +50,14 @@ struct Cursor {
     void reset_mode();
     void process_motion(uint32_t time, wlr_input_device *device, double dx,
                         double dy, double unaccel_dx, double unaccel_dy);
+    void flush_motion();
+    void process_hover(uint32_t time);
+    void record_motion(uint32_t time) const;
     void process_move();
     void process_resize();
-    void constrain(wlr_pointer_constraint_v1 *constraint);
+    void surface_coords(const struct Toplevel *toplevel, double *sx,
+                        double *sy) const;
+    void constrain(PointerConstraint *constraint);
 
     void set_config(wlr_pointer *pointer);
     void reconfigure_all();
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// number of linear buckets each power of two is split into, the bucket
+// width stays within 1/8 of the values it holds
+constexpr uint32_t HISTOGRAM_SUB_BUCKETS = 8;
+
+// enough buckets for values up to 2^32
+constexpr uint32_t HISTOGRAM_BUCKETS = 30 * HISTOGRAM_SUB_BUCKETS;
+
+// log-linear histogram of non-negative values
+struct Histogram {
+    uint64_t count{0};
+    uint64_t sum{0};
+    uint64_t min{UINT64_MAX};
+    uint64_t max{0};
+    std::array<uint64_t, HISTOGRAM_BUCKETS> buckets{};
+
+    void add(uint64_t value);
+    void reset();
+    uint64_t percentile(double p) const;
+
+    static uint32_t bucket(uint64_t value);
+    static uint64_t bucket_min(uint32_t index);
+};
@@ -0,0 +1,33 @@
+#include "wlr.h"
+#include <vector>
+
+// grid of the scene nodes covering an output, ordered top to bottom, so a hit
+// test only searches the few subtrees under the point. Rebuilt lazily after
+// Server::invalidate_hit_index.
+struct HitIndex {
+    struct Output *output;
+
+    // Server::hit_generation the index was built at
+    uint64_t generation{0};
+
+    struct Entry {
+        // toplevel or layer surface tree, or any other node, which hides
+        // whatever is below it
+        wlr_scene_node *node;
+        wlr_box box;
+    };
+
+    // entries from top to bottom
+    std::vector<Entry> entries;
+
+    // area covered by the grid and entry indices overlapping each cell, top
+    // to bottom
+    wlr_box area{};
+    int columns{0}, rows{0};
+    std::vector<std::vector<uint32_t>> cells;
+
+    HitIndex(Output *output);
+
+    void rebuild();
+    wlr_scene_node *node_at(double lx, double ly, double *nx, double *ny);
+};
@@ -0,0 +1,63 @@
+#include "IPCProtocol.h"
+#include "wlr.h"
+#include <vector>
+
+// i3 IPC messages have the same layout as awm ones with another magic
+constexpr char I3_IPC_MAGIC[] = "i3-ipc";
+
+enum I3MessageType : uint32_t {
+    I3_MESSAGE_RUN_COMMAND = 0,
+    I3_MESSAGE_GET_WORKSPACES = 1,
+    I3_MESSAGE_SUBSCRIBE = 2,
+    I3_MESSAGE_GET_OUTPUTS = 3,
+    I3_MESSAGE_GET_TREE = 4,
+    I3_MESSAGE_GET_MARKS = 5,
+    I3_MESSAGE_GET_BAR_CONFIG = 6,
+    I3_MESSAGE_GET_VERSION = 7,
+    I3_MESSAGE_GET_BINDING_MODES = 8,
+    I3_MESSAGE_GET_CONFIG = 9,
+    I3_MESSAGE_SEND_TICK = 10,
+    I3_MESSAGE_SYNC = 11,
+    I3_MESSAGE_GET_BINDING_STATE = 12,
+    I3_MESSAGE_GET_INPUTS = 100,
+    I3_MESSAGE_GET_SEATS = 101,
+};
+
+enum I3EventType : uint32_t {
+    I3_EVENT_WORKSPACE = 0x80000000,
+    I3_EVENT_OUTPUT = 0x80000001,
+    I3_EVENT_MODE = 0x80000002,
+    I3_EVENT_WINDOW = 0x80000003,
+    I3_EVENT_BARCONFIG_UPDATE = 0x80000004,
+    I3_EVENT_BINDING = 0x80000005,
+    I3_EVENT_SHUTDOWN = 0x80000006,
+    I3_EVENT_TICK = 0x80000007,
+};
+
+// i3 and sway compatible IPC socket, served beside the awm one
+struct I3IPC {
+    struct IPC *ipc;
+    int fd;
+    std::string path{"/tmp/awm-i3.sock"};
+    wl_event_source *event_source{nullptr};
+
+    // id of the root of the tree
+    uint64_t root_id;
+
+    // serialized window events waiting for the end of the event loop
+    // iteration
+    std::vector<std::string> window_changes;
+
+    // last focused workspace sent to subscribers, the `old` workspace of the
+    // next workspace event
+    std::string focused_workspace{"null"};
+
+    I3IPC(IPC *ipc);
+    ~I3IPC();
+
+    std::string run(uint32_t type, const std::string &payload,
+                    struct IPCClient *client);
+    bool subscribed(uint32_t events) const;
+    void notify_toplevel(const std::string &change, struct Toplevel *toplevel);
+    void send_events(uint32_t events);
+};
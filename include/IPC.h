@@ -1,20 +1,109 @@
-#include <atomic>
+#include "I3IPC.h"
+#include "IPCClient.h"
+#include <fcntl.h>
 #include <iostream>
+#include <map>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/un.h>
-#include <thread>
 #include <unistd.h>
+#include <vector>
+
+enum IPCEvent {
+    IPC_EVENT_FOCUS = 1 << 0,
+    IPC_EVENT_WORKSPACE = 1 << 1,
+    IPC_EVENT_TOPLEVEL = 1 << 2,
+    IPC_EVENT_OUTPUT = 1 << 3,
+    IPC_EVENT_ALL = (1 << 4) - 1,
+};
+
+enum IPCSnapshot {
+    IPC_SNAPSHOT_OUTPUTS = 1 << 0,
+    IPC_SNAPSHOT_WORKSPACES = 1 << 1,
+    IPC_SNAPSHOT_TOPLEVELS = 1 << 2,
+    IPC_SNAPSHOT_ALL = (1 << 3) - 1,
+};
+
+enum IPCActionType {
+    IPC_ACTION_FOCUS,
+    IPC_ACTION_CLOSE,
+    IPC_ACTION_SWAP,
+    IPC_ACTION_MOVE,
+    IPC_ACTION_WORKSPACE,
+    IPC_ACTION_TILE,
+    IPC_ACTION_FULLSCREEN,
+    IPC_ACTION_MAXIMIZE,
+};
+
+enum IPCActionState {
+    IPC_ACTION_OFF,
+    IPC_ACTION_ON,
+    IPC_ACTION_TOGGLE,
+};
+
+// a mutating command, resolved before any command of its batch runs
+struct IPCAction {
+    IPCActionType type;
+    struct Toplevel *toplevel{nullptr};
+    struct Toplevel *other{nullptr};
+
+    // target of moves, workspace changes and tiling
+    struct Workspace *workspace{nullptr};
+
+    // without a workspace, the active workspace of this output when the
+    // action runs
+    struct Output *output{nullptr};
+
+    IPCActionState state{IPC_ACTION_TOGGLE};
+};
+
+// serialized replies of a listing, keyed by requested fields
+struct IPCCache {
+    bool dirty{true};
+    struct Output *output{nullptr};
+    std::map<std::string, std::string> replies;
+};
 
 struct IPC {
     struct Server *server;
     int fd;
     sockaddr_un addr{};
     std::string path{"/tmp/awm.sock"};
-    std::atomic<bool> running{true};
-    std::thread thread;
+    wl_event_source *event_source{nullptr};
+    wl_list clients;
+
+    // optional i3 compatible listener
+    I3IPC *i3{nullptr};
+
+    // events waiting for the end of the event loop iteration
+    uint32_t pending_events{0};
+    std::vector<std::string> toplevel_changes;
+    wl_event_source *idle_source{nullptr};
+
+    // cached listings
+    IPCCache outputs;
+    IPCCache workspaces;
+    IPCCache toplevels;
+
+    // shared memory state page, created on first request
+    int state_fd{-1};
+    IPCState *state{nullptr};
+    bool state_dirty{false};
 
     IPC(Server *server);
 
-    std::string run(std::string command);
+    std::string run(std::string command, IPCClient *client);
+    int parse_action(const std::string &command, IPCAction *action,
+                     std::string *error) const;
+    std::string run_actions(const std::vector<std::string> &commands);
+    bool subscribed(uint32_t events) const;
+    void invalidate(uint32_t snapshots);
+    void notify(uint32_t events);
+    void notify_toplevel(const std::string &change, struct Toplevel *toplevel);
+    void schedule();
+    void send_events();
+    bool create_state();
+    void update_state();
     void stop();
 };
@@ -0,0 +1,52 @@
+#include "IPCProtocol.h"
+#include "wlr.h"
+#include <deque>
+
+enum IPCClientProtocol {
+    IPC_CLIENT_PROTOCOL_UNKNOWN,
+    IPC_CLIENT_PROTOCOL_LEGACY,
+    IPC_CLIENT_PROTOCOL_FRAMED,
+    IPC_CLIENT_PROTOCOL_I3,
+};
+
+struct IPCClient {
+    wl_list link;
+    struct IPC *ipc;
+    int fd;
+    wl_event_source *event_source;
+    uint32_t mask{WL_EVENT_READABLE};
+
+    // detected from the first bytes received
+    IPCClientProtocol protocol{IPC_CLIENT_PROTOCOL_UNKNOWN};
+
+    // no more commands will be read, close once replies are sent
+    bool done{false};
+
+    // queued too much without reading, nothing more is sent
+    bool dropped{false};
+
+    std::string read_buffer;
+    std::string write_buffer;
+
+    // subscribed IPCEvent mask
+    uint32_t subscriptions{0};
+
+    // eventfd signalled on state page updates
+    int state_eventfd{-1};
+
+    // the next reply carries the state page fds
+    bool attach_state{false};
+
+    // offsets into the write buffer of replies carrying the state page fds
+    std::deque<size_t> state_offsets;
+
+    IPCClient(IPC *ipc, int fd);
+    ~IPCClient();
+
+    bool receive();
+    bool process();
+    bool flush();
+    ssize_t send_state(size_t size);
+    void send(uint32_t type, const std::string &payload);
+    void update_mask();
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// framed IPC messages shared by awm and awmsg, every message is a header
+// followed by `length` bytes of payload, all integers in host byte order
+//
+//   "awm-ipc" | uint32_t length | uint32_t type | payload
+//
+// connections not starting with the magic are served with the legacy
+// protocol of one unframed command per connection
+
+constexpr char IPC_MAGIC[] = "awm-ipc";
+constexpr size_t IPC_MAGIC_SIZE = sizeof(IPC_MAGIC) - 1;
+constexpr size_t IPC_HEADER_SIZE = IPC_MAGIC_SIZE + 2 * sizeof(uint32_t);
+
+// largest payload accepted in either direction
+constexpr uint32_t IPC_MAX_PAYLOAD = 16 * 1024 * 1024;
+
+enum IPCMessageType : uint32_t {
+    IPC_MESSAGE_COMMAND = 0,
+    IPC_MESSAGE_REPLY = 1,
+    IPC_MESSAGE_EVENT = 2,
+};
+
+// encode a message, other framed protocols differ only in their magic
+inline std::string ipc_frame(const uint32_t type, const std::string &payload,
+                             const std::string_view magic = IPC_MAGIC) {
+    const uint32_t length = payload.size();
+
+    std::string frame(magic.size() + 2 * sizeof(uint32_t), '\0');
+    memcpy(frame.data(), magic.data(), magic.size());
+    memcpy(frame.data() + magic.size(), &length, sizeof(length));
+    memcpy(frame.data() + magic.size() + sizeof(length), &type, sizeof(type));
+
+    return frame + payload;
+}
+
+// returns true if the buffer starts with the magic, or could once more data
+// arrives
+inline bool ipc_framed(const std::string &buffer,
+                       const std::string_view magic = IPC_MAGIC) {
+    const size_t size = std::min(buffer.size(), magic.size());
+    return !buffer.compare(0, size, magic.data(), size);
+}
+
+// decode the first message of a buffer, returns 1 and consumes it if
+// complete, 0 if more data is needed and -1 if the buffer is malformed
+inline int ipc_parse(std::string &buffer, uint32_t *type, std::string *payload,
+                     const std::string_view magic = IPC_MAGIC) {
+    const size_t header_size = magic.size() + 2 * sizeof(uint32_t);
+
+    if (buffer.size() < header_size)
+        return ipc_framed(buffer, magic) ? 0 : -1;
+
+    if (buffer.compare(0, magic.size(), magic.data(), magic.size()))
+        return -1;
+
+    uint32_t length;
+    memcpy(&length, buffer.data() + magic.size(), sizeof(length));
+    memcpy(type, buffer.data() + magic.size() + sizeof(length), sizeof(*type));
+
+    if (length > IPC_MAX_PAYLOAD)
+        return -1;
+
+    if (buffer.size() < header_size + length)
+        return 0;
+
+    payload->assign(buffer, header_size, length);
+    buffer.erase(0, header_size + length);
+
+    return 1;
+}
+
+// shared memory state page, requested with the `p` command on a framed
+// connection. The reply carries a memfd holding an IPCState and an eventfd
+// signalled after every update, for as long as the connection stays open.
+//
+// The page is guarded by a seqlock: readers load `sequence`, retry while it
+// is odd, copy what they need and retry if `sequence` changed meanwhile.
+
+constexpr uint32_t IPC_STATE_MAGIC = 0x736d7761; // "awms"
+constexpr uint32_t IPC_STATE_VERSION = 1;
+
+constexpr size_t IPC_STATE_MAX_OUTPUTS = 16;
+constexpr size_t IPC_STATE_MAX_WORKSPACES = 256;
+constexpr size_t IPC_STATE_MAX_TOPLEVELS = 512;
+constexpr size_t IPC_STATE_NAME_SIZE = 64;
+constexpr size_t IPC_STATE_TITLE_SIZE = 128;
+
+struct IPCStateOutput {
+    char name[IPC_STATE_NAME_SIZE];
+    int32_t x, y, width, height;
+    int32_t refresh; // mHz
+    float scale;
+    uint32_t transform;
+    uint32_t workspace; // active workspace number
+    uint8_t adaptive;
+    uint8_t enabled;
+    uint8_t focused;
+    uint8_t padding;
+};
+
+struct IPCStateWorkspace {
+    uint32_t output; // index into outputs
+    uint32_t number;
+    uint8_t focused;
+    uint8_t padding[3];
+};
+
+struct IPCStateToplevel {
+    uint64_t id; // same as the id of IPC listings
+    uint32_t workspace; // index into workspaces
+    int32_t x, y, width, height;
+    uint8_t focused;
+    uint8_t hidden;
+    uint8_t maximized;
+    uint8_t fullscreen;
+    uint8_t xwayland;
+    uint8_t padding[3];
+    char title[IPC_STATE_TITLE_SIZE]; // truncated, nul terminated
+};
+
+struct IPCState {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> sequence;
+    uint32_t output_count;
+    uint32_t workspace_count;
+    uint32_t toplevel_count;
+
+    IPCStateOutput outputs[IPC_STATE_MAX_OUTPUTS];
+    IPCStateWorkspace workspaces[IPC_STATE_MAX_WORKSPACES];
+    IPCStateToplevel toplevels[IPC_STATE_MAX_TOPLEVELS];
+};
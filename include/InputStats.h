@@ -0,0 +1,15 @@
+#include "Histogram.h"
+
+// time from the kernel timestamp of an input event until it is sent to a
+// client, in microseconds, per device
+struct InputStats {
+    Histogram key;
+    Histogram motion;
+    Histogram button;
+
+    void reset();
+
+    static uint64_t now();
+    static uint64_t latency(uint32_t time_msec);
+    static uint64_t event_time(uint32_t time_msec);
+};
@@ -9,13 +9,19 @@ struct Keyboard {
     wl_listener key;
     wl_listener destroy;
 
+    // binds by layout, keycode and modifiers
+    std::unordered_map<uint64_t, CompiledBind> binds;
+
+    struct InputStats *stats;
+
     Keyboard(Server *server, wlr_input_device *device);
     ~Keyboard();
 
-    void update_config() const;
-    bool handle_bind(Bind bind);
-    uint32_t keysyms_raw(xkb_keycode_t keycode, const xkb_keysym_t **keysyms,
-                         uint32_t *modifiers) const;
+    void update_config();
+    void update_keymap();
+    void update_repeat() const;
+    void compile_binds();
+    bool handle_bind(CompiledBind bind);
     uint32_t keysyms_translated(xkb_keycode_t keycode,
                                 const xkb_keysym_t **keysyms,
                                 uint32_t *modifiers) const;
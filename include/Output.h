@@ -1,10 +1,29 @@
+#include "Histogram.h"
+#include "HitIndex.h"
 #include "wlr.h"
+#include <array>
+#include <string>
+
+// result of direct scanout of the last frame showing a fullscreen toplevel,
+// or why it was composited
+enum OutputScanout {
+    OUTPUTSCANOUT_NONE,
+    OUTPUTSCANOUT_DIRECT,
+    OUTPUTSCANOUT_FORMAT,
+    OUTPUTSCANOUT_OCCLUSION,
+    OUTPUTSCANOUT_SCALE,
+    OUTPUTSCANOUT_TRANSFORM,
+    OUTPUTSCANOUT_CURSOR,
+    OUTPUTSCANOUT_COUNT,
+};
 
 struct Output {
     struct wl_list link;
     struct Server *server;
+    uint64_t id;
     struct wlr_output *wlr_output;
     struct wl_listener frame;
+    struct wl_listener present;
     struct wl_listener request_state;
     struct wl_listener destroy;
 
@@ -17,10 +36,73 @@ struct Output {
         struct wlr_scene_tree *overlay;
     } layers;
 
-    wlr_scene_output *scene_output;
+    wlr_scene_output *scene_output{nullptr};
+
+    // frame events that committed a new frame, found nothing to draw or
+    // failed to commit
+    uint64_t frames_committed{0};
+    uint64_t frames_skipped{0};
+    uint64_t frames_failed{0};
+
+    // committed frames presented with an async page flip
+    uint64_t frames_torn{0};
+
+    // whether the backend takes async page flips, tested again once tearing
+    // starts or the buffer format changes
+    bool tearing_tested{false};
+    bool tearing_supported{false};
+    uint32_t tearing_format{0};
+
+    // scanout result of the last frame and frames by result
+    OutputScanout scanout{OUTPUTSCANOUT_NONE};
+    std::array<uint64_t, OUTPUTSCANOUT_COUNT> scanout_frames{};
+
+    // sample of the scanout candidate while committing
+    wl_listener scanout_sample;
+    bool scanned_out{false};
+
+    // ms to wait after the frame event before rendering, or
+    // RENDER_DELAY_AUTO
+    int32_t render_delay{0};
+    int render_timer_fd{-1};
+    wl_event_source *render_timer{nullptr};
+    bool render_pending{false};
+
+    // CLOCK_MONOTONIC time of the last presented frame and the refresh
+    // period, in ns
+    uint64_t last_present{0};
+    uint64_t refresh_period{0};
+
+    // durations of the last commits in ns, the longest is budgeted for
+    // with RENDER_DELAY_AUTO
+    std::array<uint64_t, 16> render_times{};
+    uint32_t render_time_index{0};
+
+    // last wait before rendering in ns
+    uint64_t last_render_delay{0};
+
+    // hold back frame callbacks of the toplevels on the active workspace
+    bool frame_delay{false};
+
+    // present the focused fullscreen toplevel without vsync if it asks to
+    bool allow_tearing{false};
 
     wlr_box layout_geometry;
 
+    // toplevels and layer surfaces under the cursor
+    HitIndex hit_index{this};
+
+    // committed frames showing inputs, by commit sequence, each input is its
+    // time and application id
+    struct PendingFrame {
+        uint32_t commit_seq;
+        std::vector<std::pair<uint64_t, std::string>> inputs;
+    };
+    std::vector<PendingFrame> pending_frames;
+
+    // input to present latency in microseconds
+    Histogram present_latency;
+
     struct wl_list workspaces;
     uint32_t max_workspace{0};
 
@@ -34,6 +116,15 @@ struct Output {
     void arrange_layers();
 
     void update_position();
+    uint64_t next_vblank(uint64_t now) const;
+    uint64_t next_render_delay() const;
+    bool wants_tearing() const;
+    wlr_scene_buffer *scanout_candidate(OutputScanout *reason) const;
+    bool commit();
+    void render();
+    void send_frame_done();
+    void collect_inputs();
+    void present_inputs(const wlr_output_event_present *event);
     bool apply_config(const OutputConfig *config, bool test_only);
 
     static void arrange_layer_surface(const wlr_box *full_area,
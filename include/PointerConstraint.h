@@ -1,9 +1,14 @@
 #include "wlr.h"
 
 struct PointerConstraint {
+    struct Server *server;
     wlr_pointer_constraint_v1 *constraint;
     wl_listener destroy;
 
-    PointerConstraint(wlr_pointer_constraint_v1 *constraint);
+    // toplevel of the constrained surface, looked up on activation and
+    // kept in step with the toplevel registry
+    struct Toplevel *toplevel{nullptr};
+
+    PointerConstraint(Server *server, wlr_pointer_constraint_v1 *constraint);
     ~PointerConstraint();
 };
@@ -1,11 +1,12 @@
 #include <algorithm>
-#include <atomic>
 #include <cassert>
+#include <optional>
 #include <sys/wait.h>
-#include <thread>
 #include <unistd.h>
 
+#include "ConfigWatcher.h"
 #include "IPC.h"
+#include "InputStats.h"
 #include "Keyboard.h"
 #include "LayerSurface.h"
 #include "Output.h"
@@ -13,6 +14,7 @@
 #include "PointerConstraint.h"
 #include "Popup.h"
 #include "SessionLock.h"
+#include "Surface.h"
 #include "Toplevel.h"
 #include "Workspace.h"
 
@@ -36,6 +38,7 @@ struct Server {
     wlr_renderer *renderer;
     wlr_allocator *allocator;
     wlr_compositor *compositor;
+    wl_listener new_surface;
     wlr_scene *scene;
     wlr_scene_output_layout *scene_layout;
 
@@ -91,6 +94,10 @@ struct Server {
 
     wlr_pointer_constraints_v1 *wlr_pointer_constraints;
     wl_listener new_pointer_constraint;
+    wl_listener pointer_focus_change;
+
+    // constraints by constrained surface
+    std::unordered_map<wlr_surface *, PointerConstraint *> pointer_constraints;
 
     struct wlr_viewporter *wlr_viewporter;
     struct wlr_presentation *wlr_presentation;
@@ -104,6 +111,7 @@ struct Server {
     wlr_fractional_scale_manager_v1 *wlr_fractional_scale_manager;
     wlr_alpha_modifier_v1 *wlr_alpha_modifier;
     wlr_single_pixel_buffer_manager_v1 *wlr_single_pixel_buffer_manager;
+    wlr_tearing_control_manager_v1 *wlr_tearing_control_manager;
 
 #ifdef XWAYLAND
     wlr_xwayland *xwayland;
@@ -112,26 +120,54 @@ struct Server {
 #endif
 
     struct sigaction sa{};
-    std::thread config_thread;
-    std::atomic<bool> running{true};
+    ConfigWatcher *config_watcher{nullptr};
 
     IPC *ipc{nullptr};
 
+    // identifiers of outputs, workspaces and toplevels, never reused
+    uint64_t next_id{1};
+
+    // toplevels by id for their whole lifetime, and by main surface while
+    // they are on a workspace
+    std::unordered_map<uint64_t, Toplevel *> toplevels;
+    std::unordered_map<wlr_surface *, Toplevel *> toplevel_surfaces;
+
+    // bumped whenever a hit index may be stale
+    uint64_t hit_generation{1};
+
+    // input latency by device name, kept across reconnects until reset
+    std::unordered_map<std::string, InputStats> input_stats;
+
+    // toplevels with a committed input not yet shown by an output frame
+    std::vector<Toplevel *> committed_inputs;
+
+    // input to present latency by application id
+    std::unordered_map<std::string, Histogram> present_latency;
+
+    // values of variables set by the config env before it first set them,
+    // nullopt if they were unset
+    std::unordered_map<std::string, std::optional<std::string>> inherited_env;
+
     Server(Config *config);
     ~Server();
 
     void exit() const;
+    void invalidate_hit_index();
+    void reload_config();
+    void set_env(const std::string &key, const std::string &value);
+    void restore_env(const std::string &key);
 
+    InputStats *get_input_stats(const wlr_input_device *device);
+    void note_input(wlr_surface *surface, uint32_t time_msec) const;
     Output *get_output(const wlr_output *wlr_output) const;
     Output *focused_output() const;
 
     template <typename T>
     T *surface_at(double lx, double ly, wlr_surface **surface, double *sx,
                   double *sy);
-    Toplevel *toplevel_at(double lx, double ly, wlr_surface **surface,
-                          double *sx, double *sy);
-    LayerSurface *layer_surface_at(double lx, double ly, wlr_surface **surface,
-                                   double *sx, double *sy);
+    void target_at(double lx, double ly, Toplevel **toplevel,
+                   LayerSurface **layer_surface, wlr_surface **surface,
+                   double *sx, double *sy);
 
     Workspace *get_workspace(Toplevel *toplevel) const;
 
@@ -0,0 +1,10 @@
+#include <string>
+
+// commands are launched by a helper process forked at startup, while the
+// compositor is still small, so running one never forks the compositor
+
+// fork the spawn helper
+void spawner_start();
+
+// run a command with /bin/sh -c, in the current environment
+void spawn(const std::string &command);
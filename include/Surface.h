@@ -0,0 +1,13 @@
+#include "wlr.h"
+
+// commit listener of a client surface, commits of subsurfaces are forwarded
+// to the toplevel owning them
+struct Surface {
+    struct Server *server;
+    wlr_surface *surface;
+    wl_listener commit;
+    wl_listener destroy;
+
+    Surface(Server *server, wlr_surface *surface);
+    ~Surface();
+};
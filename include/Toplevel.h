@@ -1,8 +1,10 @@
 #include "Cursor.h"
+#include <array>
 
 struct Toplevel {
     wl_list link;
     Server *server;
+    uint64_t id;
     wlr_scene_tree *scene_tree{nullptr};
     wlr_scene_surface *scene_surface{nullptr};
 
@@ -20,7 +22,7 @@ struct Toplevel {
     wl_listener request_minimize;
     //  wl_listener request_show_window_menu;
     //  wl_listener set_parent;
-    //  wl_listener set_title;
+    wl_listener set_title;
     //  wl_listener set_app_id;
 
 #ifdef XWAYLAND
@@ -49,10 +51,37 @@ struct Toplevel {
     wl_listener handle_destroy;
 
     bool hidden{false};
+    uint32_t configure_serial{0};
 
     wlr_box geometry{};
     wlr_box saved_geometry{};
 
+    // workspace holding the toplevel and its output, set by
+    // Workspace::add_toplevel
+    struct Workspace *workspace{nullptr};
+    struct Output *output{nullptr};
+
+    // CLOCK_MONOTONIC time in microseconds of the first input sent since the
+    // last commit, and of the first committed input not yet on screen
+    uint64_t input_time{0};
+    uint64_t committed_input_time{0};
+
+    // frame callbacks held back by the output frame_delay, on a timerfd for
+    // ns precision
+    int frame_timer_fd{-1};
+    wl_event_source *frame_timer{nullptr};
+
+    // CLOCK_MONOTONIC time in ns frame done was last sent, 0 once the client
+    // committed after it
+    uint64_t frame_done_time{0};
+
+    // time from frame done to the next commit of the last frames in ns
+    std::array<uint64_t, 8> client_times{};
+    uint32_t client_time_count{0};
+
+    // current delay of frame done in ms, rounded for output frames
+    uint32_t frame_delay{0};
+
     Toplevel(Server *server, wlr_xdg_toplevel *wlr_xdg_toplevel);
     ~Toplevel();
 
@@ -65,7 +94,13 @@ struct Toplevel {
 
     void create_handle();
 
+    wlr_surface *surface() const;
     std::string title() const;
+    std::string app_id() const;
+    void commit_input(const wlr_surface *surface);
+    void record_client_time();
+    void schedule_frame_done(uint64_t deadline, uint64_t now);
+    void send_frame_done();
     void focus() const;
     void begin_interactive(CursorMode mode, uint32_t edges);
     void set_position_size(double x, double y, int width, int height);
@@ -80,6 +115,8 @@ struct Toplevel {
     void toggle_maximized();
     void save_geometry();
     void close() const;
+    void invalidate_ipc() const;
+    void notify_title();
 
     void update_foreign_toplevel() const;
 };
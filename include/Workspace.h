@@ -2,20 +2,23 @@
 
 struct Workspace {
     wl_list link;
+    uint64_t id;
     uint32_t num;
     Output *output;
     wl_list toplevels;
     Toplevel *active_toplevel{nullptr};
 
     Workspace(Output *output, uint32_t num);
-    ~Workspace() = default;
+    ~Workspace();
 
     void add_toplevel(Toplevel *toplevel, bool focus);
+    void remove_toplevel(Toplevel *toplevel);
     void close(const Toplevel *toplevel);
     void close_active();
     bool contains(const Toplevel *toplevel) const;
     bool move_to(Toplevel *toplevel, Workspace *workspace);
     void swap(Toplevel *other) const;
+    void swap(Toplevel *a, Toplevel *b) const;
     Toplevel *in_direction(wlr_direction direction) const;
     void set_hidden(bool hidden) const;
     void focus();
@@ -3,6 +3,7 @@
 #include <string>
 #include <unistd.h>
 
+#include "Spawner.h"
 #include "wlr.h"
 
 // send a notification
@@ -21,11 +22,7 @@ void notify_send(const std::string &format, Args... args) {
     wlr_log(WLR_INFO, "%s", message.c_str());
 
     // send notification
-    if (fork() == 0) {
-        execl("/bin/sh", "/bin/sh", "-c",
-              ("notify-send -a awm WARNING \"" + message + "\"").c_str(),
-              nullptr);
-    }
+    spawn("notify-send -a awm WARNING \"" + message + "\"");
 }
 
 // stolen from https://stackoverflow.com/a/26221725
@@ -75,6 +75,7 @@ template <typename T> void connect(const std::pair<bool, T> &pair, T *target) {
 Config::Config() {
     path = "";
     last_write_time = std::filesystem::file_time_type::min();
+    compile_binds();
     notify_send("%s", "no config loaded, press Alt+Escape to exit awm");
 }
 
@@ -83,10 +84,11 @@ Config::Config(const std::string &path) {
     this->path = path;
 
     // get last write time
-    last_write_time = std::filesystem::last_write_time(path);
+    std::error_code ec;
+    last_write_time = std::filesystem::last_write_time(path, ec);
 
     // load config at path
-    load();
+    loaded = load();
 }
 
 // load config from path
@@ -147,6 +149,7 @@ bool Config::load() {
 
         // ipc
         connect(startup->getBool("ipc"), &ipc);
+        connect(startup->getBool("i3_ipc"), &i3_ipc);
     } else
         wlr_log(WLR_INFO, "%s", "No startup configuration found, ingoring");
 
@@ -322,6 +325,9 @@ bool Config::load() {
 
         // accel speed
         connect(pointer->getDouble("accel_speed"), &cursor.accel_speed);
+
+        // coalesce motion
+        connect(pointer->getBool("coalesce_motion"), &cursor.coalesce_motion);
     }
 
     // get awm binds
@@ -462,6 +468,20 @@ bool Config::load() {
                 // adaptive sync
                 connect(table.getBool("adaptive"), &oc->adaptive_sync);
 
+                // render delay, in ms or auto
+                connect<int32_t>(table.getInt("render_delay"),
+                                 &oc->render_delay);
+                oc->render_delay = std::max(0, oc->render_delay);
+                if (const auto delay = table.getString("render_delay");
+                    delay.first && delay.second == "auto")
+                    oc->render_delay = RENDER_DELAY_AUTO;
+
+                // frame callback delay
+                connect(table.getBool("frame_delay"), &oc->frame_delay);
+
+                // tearing
+                connect(table.getBool("allow_tearing"), &oc->allow_tearing);
+
                 // add to output configs if enough values are set
                 if (oc->name.empty() || !oc->width || !oc->height ||
                     oc->refresh <= 0.0) {
@@ -478,38 +498,69 @@ bool Config::load() {
             }
     }
 
+    // build bind table
+    compile_binds();
+
     return true;
 }
 
-// update the config
-void Config::update(const Server *server) {
-    // ignore updates on empty path
-    if (path.empty())
-        return;
-
-    // get current write time
-    const std::filesystem::file_time_type current_write_time =
-        std::filesystem::last_write_time(path);
+// resolve binds and commands into the bind table, so a key press is looked up
+// instead of compared against every bind
+void Config::compile_binds() {
+    bind_table.clear();
+
+    // user-defined commands take precedence over compositor binds
+    for (uint32_t i = 0; i != commands.size(); ++i)
+        bind_table.emplace(
+            bind_key(commands[i].first.modifiers, commands[i].first.sym),
+            CompiledBind{BIND_COMMAND, i});
+
+    // compositor binds
+    const std::pair<Bind, BindAction> actions[] = {
+        {exit, BIND_EXIT},
+        {window_fullscreen, BIND_WINDOW_FULLSCREEN},
+        {window_previous, BIND_WINDOW_PREVIOUS},
+        {window_next, BIND_WINDOW_NEXT},
+        {window_move, BIND_WINDOW_MOVE},
+        {window_up, BIND_WINDOW_UP},
+        {window_down, BIND_WINDOW_DOWN},
+        {window_left, BIND_WINDOW_LEFT},
+        {window_right, BIND_WINDOW_RIGHT},
+        {window_close, BIND_WINDOW_CLOSE},
+        {window_swap_up, BIND_WINDOW_SWAP_UP},
+        {window_swap_down, BIND_WINDOW_SWAP_DOWN},
+        {window_swap_left, BIND_WINDOW_SWAP_LEFT},
+        {window_swap_right, BIND_WINDOW_SWAP_RIGHT},
+        {workspace_tile, BIND_WORKSPACE_TILE},
+    };
 
-    // check if the file has been modified
-    if (current_write_time == last_write_time)
-        return;
+    for (const auto &[bind, action] : actions)
+        if (bind.sym != XKB_KEY_NoSymbol)
+            bind_table.emplace(bind_key(bind.modifiers, bind.sym),
+                               CompiledBind{action});
 
-    // update write time
-    last_write_time = current_write_time;
+    // Number binds, one entry per digit
+    for (xkb_keysym_t sym = XKB_KEY_0; sym <= XKB_KEY_9; ++sym) {
+        // 0 is on the right of 9 so it makes more sense this way
+        const uint32_t n = XKB_KEY_0 == sym ? 10 : sym - XKB_KEY_0 - 1;
 
-    // load new config
-    if (!load())
-        return;
+        bind_table.emplace(bind_key(workspace_open.modifiers, sym),
+                           CompiledBind{BIND_WORKSPACE_OPEN, n});
+        bind_table.emplace(bind_key(workspace_window_to.modifiers, sym),
+                           CompiledBind{BIND_WORKSPACE_WINDOW_TO, n});
+    }
+}
 
-    // update keyboard config
-    const wlr_keyboard *wlr_keyboard = wlr_seat_get_keyboard(server->seat);
-    const auto *keyboard = static_cast<Keyboard *>(wlr_keyboard->data);
-    keyboard->update_config();
+// get the config of the output with name, or nullptr
+OutputConfig *Config::output_config(const std::string &name) const {
+    for (OutputConfig *config : outputs)
+        if (config->name == name)
+            return config;
 
-    // update cursor config
-    server->cursor->reconfigure_all();
+    return nullptr;
+}
 
-    // notify user of reload
-    notify_send("%s", "config reload complete");
+Config::~Config() {
+    for (const OutputConfig *config : outputs)
+        delete config;
 }
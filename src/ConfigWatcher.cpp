@@ -0,0 +1,102 @@
+#include "Server.h"
+#include <filesystem>
+#include <sys/inotify.h>
+
+// time to let a burst of writes settle before reloading, in ms
+constexpr int CONFIG_DEBOUNCE = 5;
+
+ConfigWatcher::ConfigWatcher(Server *server, const std::string &path)
+    : server(server) {
+    // split path into the directory and the file name inside it
+    const std::filesystem::path absolute = std::filesystem::absolute(path);
+    directory = absolute.parent_path().string();
+    name = absolute.filename().string();
+
+    // create inotify instance
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1) {
+        wlr_log(WLR_ERROR, "failed to watch config: %s", strerror(errno));
+        return;
+    }
+
+    // watch the directory for the file being replaced or recreated
+    directory_watch =
+        inotify_add_watch(fd, directory.c_str(),
+                          IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+    if (directory_watch == -1)
+        wlr_log(WLR_ERROR, "failed to watch %s: %s", directory.c_str(),
+                strerror(errno));
+
+    // watch the file itself
+    watch_file();
+
+    wl_event_loop *event_loop = wl_display_get_event_loop(server->display);
+
+    // read events as they arrive
+    event_source = wl_event_loop_add_fd(
+        event_loop, fd, WL_EVENT_READABLE,
+        [](int, uint32_t, void *data) {
+            static_cast<ConfigWatcher *>(data)->handle_events();
+            return 0;
+        },
+        this);
+
+    // reload once events stop arriving
+    debounce = wl_event_loop_add_timer(
+        event_loop,
+        [](void *data) {
+            static_cast<ConfigWatcher *>(data)->server->reload_config();
+            return 0;
+        },
+        this);
+}
+
+// (re)add the watch on the file, replacing the file drops its old watch
+void ConfigWatcher::watch_file() {
+    const std::string path = directory + "/" + name;
+
+    file_watch = inotify_add_watch(fd, path.c_str(), IN_CLOSE_WRITE);
+}
+
+void ConfigWatcher::handle_events() {
+    alignas(inotify_event) char buffer[4096];
+    bool changed = false;
+
+    // drain the queue
+    ssize_t len;
+    while ((len = read(fd, buffer, sizeof(buffer))) > 0)
+        for (char *p = buffer; p < buffer + len;) {
+            const auto *event = reinterpret_cast<inotify_event *>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->wd == file_watch) {
+                // old file is gone, its replacement is picked up below
+                if (event->mask & IN_IGNORED)
+                    file_watch = -1;
+                else
+                    changed = true;
+            } else if (event->wd == directory_watch && event->len &&
+                       name == event->name) {
+                // file was created or renamed over, watch the new one
+                if (event->mask & (IN_MOVED_TO | IN_CREATE))
+                    watch_file();
+
+                changed = true;
+            }
+        }
+
+    // (re)arm the debounce timer
+    if (changed)
+        wl_event_source_timer_update(debounce, CONFIG_DEBOUNCE);
+}
+
+ConfigWatcher::~ConfigWatcher() {
+    if (debounce)
+        wl_event_source_remove(debounce);
+
+    if (event_source)
+        wl_event_source_remove(event_source);
+
+    if (fd != -1)
+        close(fd);
+}
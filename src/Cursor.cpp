@@ -33,6 +33,28 @@ Cursor::Cursor(Server *server) : server(server) {
         // relative motion event
         Cursor *cursor = wl_container_of(listener, cursor, motion);
         const auto *event = static_cast<wlr_pointer_motion_event *>(data);
+        ++cursor->motion_events;
+
+        // the pointer stays put while locked, only send the relative motion,
+        // an unmapped locked surface gets the full path to lose focus
+        const PointerConstraint *constraint = cursor->active_constraint;
+        if (cursor->locked && cursor->cursor_mode == CURSORMODE_PASSTHROUGH &&
+            constraint && constraint->toplevel &&
+            constraint->constraint->surface->mapped) {
+            ++cursor->locked_motion_events;
+            wlr_relative_pointer_manager_v1_send_relative_motion(
+                cursor->server->wlr_relative_pointer_manager,
+                cursor->server->seat,
+                static_cast<uint64_t>(event->time_msec) * 1000,
+                event->delta_x, event->delta_y, event->unaccel_dx,
+                event->unaccel_dy);
+            cursor->server->get_input_stats(&event->pointer->base)
+                ->motion.add(InputStats::latency(event->time_msec));
+            cursor->server->note_input(
+                cursor->server->seat->pointer_state.focused_surface,
+                event->time_msec);
+            return;
+        }
 
         // process motion
         cursor->process_motion(event->time_msec, &event->pointer->base,
@@ -47,6 +69,7 @@ Cursor::Cursor(Server *server) : server(server) {
         Cursor *cursor = wl_container_of(listener, cursor, motion_absolute);
         const auto *event =
             static_cast<wlr_pointer_motion_absolute_event *>(data);
+        ++cursor->motion_events;
 
         // warp cursor
         if (event->time_msec)
@@ -72,9 +95,17 @@ Cursor::Cursor(Server *server) : server(server) {
         Cursor *cursor = wl_container_of(listener, cursor, button);
         const auto *event = static_cast<wlr_pointer_button_event *>(data);
 
+        // focus the surface under the cursor first
+        cursor->flush_motion();
+
         // forward to seat
         wlr_seat_pointer_notify_button(cursor->server->seat, event->time_msec,
                                        event->button, event->state);
+        cursor->server->get_input_stats(&event->pointer->base)
+            ->button.add(InputStats::latency(event->time_msec));
+        cursor->server->note_input(
+            cursor->server->seat->pointer_state.focused_surface,
+            event->time_msec);
 
         if (event->state == WL_POINTER_BUTTON_STATE_RELEASED)
             // show standard pointer cursor
@@ -85,18 +116,17 @@ Cursor::Cursor(Server *server) : server(server) {
 
             double sx, sy;
             wlr_surface *surface = nullptr;
+            Toplevel *toplevel;
+            LayerSurface *layer_surface;
+            server->target_at(cursor->cursor->x, cursor->cursor->y, &toplevel,
+                              &layer_surface, &surface, &sx, &sy);
 
             // layer surface focus
-            LayerSurface *layer_surface = server->layer_surface_at(
-                cursor->cursor->x, cursor->cursor->y, &surface, &sx, &sy);
-            if (layer_surface && surface && surface->mapped)
-                if (layer_surface->should_focus())
-                    layer_surface->handle_focus();
+            if (layer_surface && layer_surface->should_focus())
+                layer_surface->handle_focus();
 
             // toplevel focus
-            Toplevel *toplevel = server->toplevel_at(
-                cursor->cursor->x, cursor->cursor->y, &surface, &sx, &sy);
-            if (toplevel && surface && surface->mapped)
+            if (toplevel)
                 server->focused_output()->get_active()->focus_toplevel(
                     toplevel);
         }
@@ -110,6 +140,9 @@ Cursor::Cursor(Server *server) : server(server) {
 
         const auto *event = static_cast<wlr_pointer_axis_event *>(data);
 
+        // focus the surface under the cursor first
+        cursor->flush_motion();
+
         // forward to seat
         wlr_seat_pointer_notify_axis(cursor->server->seat, event->time_msec,
                                      event->orientation, event->delta,
@@ -122,7 +155,8 @@ Cursor::Cursor(Server *server) : server(server) {
     frame.notify = [](wl_listener *listener, [[maybe_unused]] void *data) {
         Cursor *cursor = wl_container_of(listener, cursor, frame);
 
-        // forward to seat
+        // forward to seat right away, it closes the relative motion already
+        // sent, deferred motion gets its own frame when flushed
         wlr_seat_pointer_notify_frame(cursor->server->seat);
     };
     wl_signal_add(&cursor->events.frame, &frame);
@@ -154,42 +188,35 @@ void Cursor::process_motion(uint32_t time, wlr_input_device *device, double dx,
             server->wlr_relative_pointer_manager, server->seat,
             static_cast<uint64_t>(time) * 1000, dx, dy, unaccel_dx, unaccel_dy);
 
-        // constrain cursor
-        wlr_pointer_constraint_v1 *constraint;
-        wl_list_for_each(constraint,
-                         &server->wlr_pointer_constraints->constraints, link)
-            constrain(constraint);
-
-        if (active_constraint && cursor_mode != CURSORMODE_RESIZE &&
+        // the constraint of the focused surface, activated on focus change
+        if (active_constraint && active_constraint->toplevel &&
+            active_constraint->constraint->surface->mapped &&
+            cursor_mode != CURSORMODE_RESIZE &&
             cursor_mode != CURSORMODE_MOVE) {
-            // get the toplevel which the constraint is applied to
-            const auto *toplevel =
-                server->get_toplevel(active_constraint->surface);
-
-            // ensure toplevel is focused
-            if (toplevel && active_constraint->surface ==
-                                server->seat->pointer_state.focused_surface) {
-                const wlr_box geo_box = toplevel->geometry;
-
-                // calculate constraint
-                double sx = cursor->x - geo_box.x - geo_box.width;
-                double sy = cursor->y - geo_box.y - geo_box.height;
-                double cx, cy;
-
-                // apply confine on region
-                if (wlr_region_confine(&active_constraint->region, sx, sy,
-                                       sx + dx, sy + dy, &cx, &cy)) {
-                    dx = cx - sx;
-                    dy = cy - sy;
-                }
-
-                // if pointer is locked, do not move it
-                if (active_constraint->type == WLR_POINTER_CONSTRAINT_V1_LOCKED)
-                    return;
+            wlr_pointer_constraint_v1 *constraint =
+                active_constraint->constraint;
+
+            // if pointer is locked, do not move it
+            if (constraint->type == WLR_POINTER_CONSTRAINT_V1_LOCKED)
+                return;
+
+            // surface-local position of the cursor
+            double sx, sy;
+            surface_coords(active_constraint->toplevel, &sx, &sy);
+            double cx, cy;
+
+            // apply confine on region
+            if (wlr_region_confine(&constraint->region, sx, sy, sx + dx,
+                                   sy + dy, &cx, &cy)) {
+                dx = cx - sx;
+                dy = cy - sy;
             }
         }
     }
 
+    if (time && device)
+        motion_stats = server->get_input_stats(device);
+
     // update drag icon position
     wlr_scene_node_set_position(&server->layers.drag_icon->node, cursor->x,
                                 cursor->y);
@@ -197,6 +224,37 @@ void Cursor::process_motion(uint32_t time, wlr_input_device *device, double dx,
     // move cursor
     wlr_cursor_move(cursor, device, dx, dy);
 
+    // defer the rest to the next frame of the output under the cursor
+    if (time && server->config->cursor.coalesce_motion)
+        if (Output *output =
+                server->output_manager->output_at(cursor->x, cursor->y)) {
+            motion_time = time;
+
+            if (!motion_pending) {
+                motion_pending = true;
+                wlr_output_schedule_frame(output->wlr_output);
+            }
+            return;
+        }
+
+    process_hover(time);
+}
+
+// run motion deferred by coalesce_motion, called once per output frame
+void Cursor::flush_motion() {
+    if (!motion_pending)
+        return;
+
+    motion_pending = false;
+    process_hover(motion_time);
+
+    // close the deferred motion
+    wlr_seat_pointer_notify_frame(server->seat);
+}
+
+// move or resize the grabbed toplevel, or update pointer focus and send
+// motion to the surface under the cursor
+void Cursor::process_hover(const uint32_t time) {
     // move or resize toplevel
     if (cursor_mode == CURSORMODE_MOVE) {
         process_move();
@@ -210,23 +268,16 @@ void Cursor::process_motion(uint32_t time, wlr_input_device *device, double dx,
     double sx, sy;
     wlr_surface *surface = nullptr;
 
-    // get the toplevel under the cursor (if exists)
-    const Toplevel *toplevel =
-        server->toplevel_at(cursor->x, cursor->y, &surface, &sx, &sy);
-    if (toplevel && surface && surface->mapped) {
-        // connect the seat to the toplevel
-        wlr_seat_pointer_notify_enter(server->seat, surface, sx, sy);
-        wlr_seat_pointer_notify_motion(server->seat, time, sx, sy);
-        return;
-    }
-
-    // get the layer surface under the cursor (if exists)
-    LayerSurface *layer_surface =
-        server->layer_surface_at(cursor->x, cursor->y, &surface, &sx, &sy);
-    if (layer_surface && surface && surface->mapped) {
-        // connect the seat to the layer surface
+    // get the toplevel or layer surface under the cursor (if exists)
+    Toplevel *toplevel;
+    LayerSurface *layer_surface;
+    server->target_at(cursor->x, cursor->y, &toplevel, &layer_surface,
+                      &surface, &sx, &sy);
+    if (toplevel || layer_surface) {
+        // connect the seat to the toplevel or layer surface
         wlr_seat_pointer_notify_enter(server->seat, surface, sx, sy);
         wlr_seat_pointer_notify_motion(server->seat, time, sx, sy);
+        record_motion(time);
         return;
     }
 
@@ -235,6 +286,14 @@ void Cursor::process_motion(uint32_t time, wlr_input_device *device, double dx,
     wlr_seat_pointer_clear_focus(server->seat);
 }
 
+// record the latency of motion sent to a client
+void Cursor::record_motion(const uint32_t time) const {
+    if (time && motion_stats)
+        motion_stats->motion.add(InputStats::latency(time));
+
+    server->note_input(server->seat->pointer_state.focused_surface, time);
+}
+
 // move a toplevel
 void Cursor::process_move() {
     // do not move fullscreen toplevel
@@ -261,6 +320,8 @@ void Cursor::process_move() {
     // update position
     server->grabbed_toplevel->geometry.x = new_x;
     server->grabbed_toplevel->geometry.y = new_y;
+    server->grabbed_toplevel->invalidate_ipc();
+    server->invalidate_hit_index();
 
     // move toplevel to different workspace if it's moved into other output
     Workspace *target = server->focused_output()->get_active();
@@ -336,21 +397,53 @@ void Cursor::process_resize() {
     toplevel->geometry.y = new_y;
     toplevel->geometry.width = new_width;
     toplevel->geometry.height = new_height;
+    toplevel->invalidate_ipc();
+    server->invalidate_hit_index();
 }
 
-// constrain the cursor to a given pointer constraint
-void Cursor::constrain(wlr_pointer_constraint_v1 *constraint) {
+// get the cursor position relative to the main surface of a toplevel
+void Cursor::surface_coords(const Toplevel *toplevel, double *sx,
+                            double *sy) const {
+    int x, y;
+#ifdef XWAYLAND
+    if (toplevel->xwayland_surface)
+        wlr_scene_node_coords(&toplevel->scene_surface->buffer->node, &x, &y);
+    else {
+#endif
+        // the surface is offset by the window geometry in its tree
+        wlr_scene_node_coords(&toplevel->scene_tree->node, &x, &y);
+        x -= toplevel->xdg_toplevel->base->geometry.x;
+        y -= toplevel->xdg_toplevel->base->geometry.y;
+#ifdef XWAYLAND
+    }
+#endif
+
+    *sx = cursor->x - x;
+    *sy = cursor->y - y;
+}
+
+// constrain the cursor to a given pointer constraint, or none
+void Cursor::constrain(PointerConstraint *constraint) {
     // no change in constraint
     if (active_constraint == constraint)
         return;
 
     // deactivate current constraint
     if (active_constraint)
-        wlr_pointer_constraint_v1_send_deactivated(active_constraint);
+        wlr_pointer_constraint_v1_send_deactivated(
+            active_constraint->constraint);
 
-    // set the new constraint
+    // set the new constraint, locking skips all motion processing
     active_constraint = constraint;
-    wlr_pointer_constraint_v1_send_activated(constraint);
+    locked = constraint &&
+             constraint->constraint->type == WLR_POINTER_CONSTRAINT_V1_LOCKED;
+    if (!constraint)
+        return;
+
+    // cache the toplevel for motion events
+    constraint->toplevel =
+        server->get_toplevel(constraint->constraint->surface);
+    wlr_pointer_constraint_v1_send_activated(constraint->constraint);
 }
 
 // set the cursor libinput configuration
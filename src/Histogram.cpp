@@ -0,0 +1,59 @@
+#include "Histogram.h"
+#include <algorithm>
+
+// record a value
+void Histogram::add(const uint64_t value) {
+    ++count;
+    sum += value;
+    min = std::min(min, value);
+    max = std::max(max, value);
+    ++buckets[bucket(value)];
+}
+
+// drop all recorded values
+void Histogram::reset() { *this = {}; }
+
+// get the upper bound of the bucket holding the p-th percentile, 0 <= p <= 1
+uint64_t Histogram::percentile(const double p) const {
+    if (!count)
+        return 0;
+
+    // rank of the value, starting at 1
+    const uint64_t rank =
+        std::max<uint64_t>(1, static_cast<uint64_t>(p * count + 0.5));
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i != HISTOGRAM_BUCKETS; ++i)
+        if ((seen += buckets[i]) >= rank)
+            return i + 1 == HISTOGRAM_BUCKETS
+                       ? max
+                       : std::min(max, bucket_min(i + 1) - 1);
+
+    return max;
+}
+
+// get the bucket of a value, small values get a bucket each and every power
+// of two above them is split into HISTOGRAM_SUB_BUCKETS
+uint32_t Histogram::bucket(const uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS)
+        return value;
+
+    // position of the highest bit, at least 3
+    const uint32_t exponent = 63 - __builtin_clzll(value);
+    const uint32_t sub =
+        (value >> (exponent - 3)) & (HISTOGRAM_SUB_BUCKETS - 1);
+
+    return std::min(HISTOGRAM_BUCKETS - 1,
+                    (exponent - 2) * HISTOGRAM_SUB_BUCKETS + sub);
+}
+
+// get the smallest value held by a bucket
+uint64_t Histogram::bucket_min(const uint32_t index) {
+    if (index < HISTOGRAM_SUB_BUCKETS)
+        return index;
+
+    const uint32_t exponent = index / HISTOGRAM_SUB_BUCKETS + 2;
+    const uint64_t sub = index % HISTOGRAM_SUB_BUCKETS;
+
+    return (HISTOGRAM_SUB_BUCKETS + sub) << (exponent - 3);
+}
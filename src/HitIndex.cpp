@@ -0,0 +1,159 @@
+#include "Server.h"
+
+// side of a grid cell in layout pixels
+constexpr int HIT_INDEX_CELL = 256;
+
+HitIndex::HitIndex(Output *output) : output(output) {}
+
+// grow box to include a buffer, sx and sy are relative to the parent of the
+// node being iterated
+static void add_buffer(wlr_scene_buffer *buffer, const int sx, const int sy,
+                       void *data) {
+    auto *box = static_cast<wlr_box *>(data);
+
+    int width = buffer->dst_width, height = buffer->dst_height;
+    if ((!width || !height) && buffer->buffer) {
+        width = buffer->buffer->width;
+        height = buffer->buffer->height;
+    }
+
+    if (width <= 0 || height <= 0)
+        return;
+
+    // first buffer
+    if (wlr_box_empty(box)) {
+        *box = {sx, sy, width, height};
+        return;
+    }
+
+    const int x1 = std::min(box->x, sx);
+    const int y1 = std::min(box->y, sy);
+    const int x2 = std::max(box->x + box->width, sx + width);
+    const int y2 = std::max(box->y + box->height, sy + height);
+    *box = {x1, y1, x2 - x1, y2 - y1};
+}
+
+// layout box covered by the buffers of a tree
+static wlr_box node_box(wlr_scene_node *node) {
+    wlr_box box{};
+    wlr_scene_node_for_each_buffer(node, add_buffer, &box);
+
+    // buffers are relative to the parent
+    int x = 0, y = 0;
+    if (node->parent)
+        wlr_scene_node_coords(&node->parent->node, &x, &y);
+    box.x += x;
+    box.y += y;
+
+    return box;
+}
+
+// returns true if tree is one of the layers holding toplevels and layer
+// surfaces
+static bool is_layer(const Server *server, const wlr_scene_tree *tree) {
+    if (tree == &server->scene->tree || tree == server->layers.background ||
+        tree == server->layers.bottom || tree == server->layers.floating ||
+        tree == server->layers.fullscreen || tree == server->layers.top ||
+        tree == server->layers.overlay || tree == server->layers.lock)
+        return true;
+
+    Output *output, *tmp;
+    wl_list_for_each_safe(output, tmp, &server->output_manager->outputs, link)
+        if (tree == output->layers.background ||
+            tree == output->layers.bottom || tree == output->layers.top ||
+            tree == output->layers.overlay)
+            return true;
+
+    return false;
+}
+
+// add the enabled nodes of a layer from top to bottom, descending into
+// nested layers only
+static void collect(const Server *server, wlr_scene_tree *tree,
+                    const wlr_box &area,
+                    std::vector<HitIndex::Entry> &entries) {
+    wlr_scene_node *node;
+    wl_list_for_each_reverse(node, &tree->children, link) {
+        // drag icons never accept input
+        if (!node->enabled || node == &server->layers.drag_icon->node)
+            continue;
+
+        if (node->type == WLR_SCENE_NODE_TREE &&
+            is_layer(server, wlr_scene_tree_from_node(node))) {
+            collect(server, wlr_scene_tree_from_node(node), area, entries);
+            continue;
+        }
+
+        // toplevels and layer surfaces are invalidated when they change,
+        // anything else may cover the whole output
+        wlr_box box = node->data ? node_box(node) : area;
+
+        // skip nodes not on the output
+        wlr_box intersection;
+        if (wlr_box_intersection(&intersection, &box, &area))
+            entries.push_back({node, box});
+    }
+}
+
+// rebuild the index from the scene
+void HitIndex::rebuild() {
+    const Server *server = output->server;
+    generation = server->hit_generation;
+    area = output->layout_geometry;
+
+    entries.clear();
+    collect(server, &server->scene->tree, area, entries);
+
+    // size the grid to the output
+    columns = std::max(1, (area.width + HIT_INDEX_CELL - 1) / HIT_INDEX_CELL);
+    rows = std::max(1, (area.height + HIT_INDEX_CELL - 1) / HIT_INDEX_CELL);
+    cells.assign(columns * rows, {});
+
+    // add each entry to the cells it overlaps, keeping z-order
+    for (uint32_t i = 0; i != entries.size(); ++i) {
+        const wlr_box &box = entries[i].box;
+
+        const int left = std::max(0, (box.x - area.x) / HIT_INDEX_CELL);
+        const int top = std::max(0, (box.y - area.y) / HIT_INDEX_CELL);
+        const int right = std::min(
+            columns - 1, (box.x + box.width - 1 - area.x) / HIT_INDEX_CELL);
+        const int bottom = std::min(
+            rows - 1, (box.y + box.height - 1 - area.y) / HIT_INDEX_CELL);
+
+        for (int row = top; row <= bottom; ++row)
+            for (int column = left; column <= right; ++column)
+                cells[row * columns + column].push_back(i);
+    }
+}
+
+// find the topmost node at a point on the output, same as wlr_scene_node_at
+// on the whole scene
+wlr_scene_node *HitIndex::node_at(const double lx, const double ly,
+                                  double *nx, double *ny) {
+    // rebuild if the scene or output changed
+    const wlr_box &geometry = output->layout_geometry;
+    if (generation != output->server->hit_generation ||
+        memcmp(&area, &geometry, sizeof(wlr_box)))
+        rebuild();
+
+    if (!wlr_box_contains_point(&area, lx, ly))
+        return nullptr;
+
+    const int column = std::min(
+        columns - 1, static_cast<int>(lx - area.x) / HIT_INDEX_CELL);
+    const int row =
+        std::min(rows - 1, static_cast<int>(ly - area.y) / HIT_INDEX_CELL);
+
+    // exact lookup inside each candidate, topmost first
+    for (const uint32_t i : cells[row * columns + column]) {
+        const Entry &entry = entries[i];
+        if (!wlr_box_contains_point(&entry.box, lx, ly))
+            continue;
+
+        if (wlr_scene_node *node =
+                wlr_scene_node_at(entry.node, lx, ly, nx, ny))
+            return node;
+    }
+
+    return nullptr;
+}
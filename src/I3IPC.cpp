@@ -0,0 +1,496 @@
+#include "Server.h"
+#include "wlr/util/log.h"
+#include <nlohmann/json.hpp>
+#include <wayland-util.h>
+using json = nlohmann::json;
+
+I3IPC::I3IPC(IPC *ipc) : ipc(ipc), root_id(ipc->server->next_id++) {
+    // create file descriptor
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        wlr_log(WLR_ERROR, "%s", "failed to create i3 IPC socket");
+        return;
+    }
+
+    // unlink old socket if present
+    if (!unlink(path.c_str()))
+        wlr_log(WLR_INFO, "removed old socket at path `%s`", path.c_str());
+
+    // set socket address
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    // bind socket
+    if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr),
+             sizeof(struct sockaddr_un)) == -1) {
+        wlr_log(WLR_ERROR, "failed to bind socket with fd `%d` on path `%s`",
+                fd, path.c_str());
+        return;
+    }
+
+    // listen for connections
+    if (listen(fd, SOMAXCONN) == -1) {
+        wlr_log(WLR_ERROR,
+                "failed to listen on socket with fd `%d` on path `%s`", fd,
+                path.c_str());
+        return;
+    }
+
+    // accept connections on the compositor event loop, clients share the
+    // awm IPC client list so events and teardown are handled in one place
+    event_source = wl_event_loop_add_fd(
+        wl_display_get_event_loop(ipc->server->display), fd, WL_EVENT_READABLE,
+        [](int fd, [[maybe_unused]] uint32_t mask, void *data) {
+            I3IPC *i3 = static_cast<I3IPC *>(data);
+
+            // accept every pending connection
+            int client_fd;
+            while ((client_fd = accept4(fd, nullptr, nullptr,
+                                        SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+                IPCClient *client = new IPCClient(i3->ipc, client_fd);
+                client->protocol = IPC_CLIENT_PROTOCOL_I3;
+            }
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                wlr_log(WLR_ERROR,
+                        "failed to accept connection on socket with fd `%d` "
+                        "on path `%s`",
+                        fd, i3->path.c_str());
+
+            return 0;
+        },
+        this);
+
+    // point i3 and sway tools at the socket
+    setenv("I3SOCK", path.c_str(), true);
+    setenv("SWAYSOCK", path.c_str(), true);
+
+    wlr_log(WLR_INFO, "started i3 IPC on socket %d", fd);
+}
+
+static json rect(const wlr_box &box) {
+    return {
+        {"x", box.x},
+        {"y", box.y},
+        {"width", box.width},
+        {"height", box.height},
+    };
+}
+
+// the toplevel with keyboard focus in i3 terms
+static Toplevel *focused_toplevel(const Server *server) {
+    Output *output = server->focused_output();
+    return output ? output->get_active()->active_toplevel : nullptr;
+}
+
+// awm always shows the active workspace of each output and keeps the rest
+// around, i3 only has workspaces which are visible or hold windows
+static std::vector<Workspace *> workspaces(Output *output) {
+    std::vector<Workspace *> list;
+
+    Workspace *workspace;
+    wl_list_for_each(workspace, &output->workspaces, link) {
+        if (workspace == output->get_active() ||
+            !wl_list_empty(&workspace->toplevels))
+            list.push_back(workspace);
+    }
+
+    // workspaces are kept most recently used first
+    std::sort(list.begin(), list.end(),
+              [](const Workspace *a, const Workspace *b) {
+                  return a->num < b->num;
+              });
+
+    return list;
+}
+
+// build a window container
+static json container(Toplevel *toplevel, const bool focused) {
+    json j = {
+        {"id", toplevel->id},
+        {"type", "con"},
+        {"name", toplevel->title()},
+        {"rect", rect(toplevel->geometry)},
+        {"focused", focused},
+        {"visible", !toplevel->hidden},
+        {"urgent", false},
+        {"fullscreen_mode", toplevel->fullscreen() ? 1 : 0},
+        {"layout", "none"},
+        {"border", "none"},
+        {"nodes", json::array()},
+        {"floating_nodes", json::array()},
+        {"focus", json::array()},
+    };
+
+#ifdef XWAYLAND
+    if (wlr_xwayland_surface *surface = toplevel->xwayland_surface) {
+        j["shell"] = "xwayland";
+        j["app_id"] = nullptr;
+        j["pid"] = surface->pid;
+        j["window"] = surface->window_id;
+        j["window_properties"] = {
+            {"class", surface->class_ ? surface->class_ : ""},
+            {"title", toplevel->title()},
+        };
+
+        return j;
+    }
+#endif
+
+    pid_t pid = 0;
+    wl_client_get_credentials(toplevel->xdg_toplevel->base->client->client,
+                              &pid, nullptr, nullptr);
+
+    j["shell"] = "xdg_shell";
+    j["app_id"] = toplevel->xdg_toplevel->app_id
+                      ? json(toplevel->xdg_toplevel->app_id)
+                      : json(nullptr);
+    j["pid"] = pid;
+
+    return j;
+}
+
+// build a workspace, with its windows for the tree and events
+static json workspace(const Server *server, Workspace *workspace,
+                      const bool nodes) {
+    Output *output = workspace->output;
+    const bool visible = workspace == output->get_active();
+
+    json j = {
+        {"id", workspace->id},
+        {"type", "workspace"},
+        {"name", std::to_string(workspace->num + 1)},
+        {"num", workspace->num + 1},
+        {"output", output->wlr_output->name},
+        {"visible", visible},
+        {"focused", visible && output == server->focused_output()},
+        {"urgent", false},
+        {"layout", "splith"},
+        {"rect", rect(output->layout_geometry)},
+    };
+
+    if (!nodes)
+        return j;
+
+    json containers = json::array();
+    json focus = json::array();
+
+    // focus lists the most recently focused child first
+    if (workspace->active_toplevel)
+        focus.push_back(workspace->active_toplevel->id);
+
+    const Toplevel *focused = focused_toplevel(server);
+
+    Toplevel *toplevel;
+    wl_list_for_each(toplevel, &workspace->toplevels, link) {
+        containers.push_back(container(toplevel, toplevel == focused));
+
+        if (toplevel != workspace->active_toplevel)
+            focus.push_back(toplevel->id);
+    }
+
+    j["nodes"] = containers;
+    j["floating_nodes"] = json::array();
+    j["focus"] = focus;
+
+    return j;
+}
+
+// build an output, with its workspaces for the tree
+static json output(const Server *server, Output *output, const bool nodes) {
+    static const char *transforms[] = {
+        "normal",  "90",         "180",         "270",
+        "flipped", "flipped-90", "flipped-180", "flipped-270",
+    };
+
+    wlr_output *wlr_output = output->wlr_output;
+
+    json j = {
+        {"id", output->id},
+        {"type", "output"},
+        {"name", wlr_output->name},
+        {"make", wlr_output->make ? wlr_output->make : ""},
+        {"model", wlr_output->model ? wlr_output->model : ""},
+        {"serial", wlr_output->serial ? wlr_output->serial : ""},
+        {"active", wlr_output->enabled},
+        {"primary", false},
+        {"focused", output == server->focused_output()},
+        {"scale", wlr_output->scale},
+        {"transform", transforms[wlr_output->transform & 7]},
+        {"current_workspace", std::to_string(output->get_active()->num + 1)},
+        {"rect", rect(output->layout_geometry)},
+    };
+
+    if (wlr_output->current_mode)
+        j["current_mode"] = {
+            {"width", wlr_output->current_mode->width},
+            {"height", wlr_output->current_mode->height},
+            {"refresh", wlr_output->current_mode->refresh},
+        };
+
+    if (!nodes)
+        return j;
+
+    json list = json::array();
+    json focus = json::array();
+
+    // the active workspace is the most recently focused one
+    focus.push_back(output->get_active()->id);
+
+    for (Workspace *w : workspaces(output)) {
+        list.push_back(workspace(server, w, true));
+
+        if (w != output->get_active())
+            focus.push_back(w->id);
+    }
+
+    j["nodes"] = list;
+    j["floating_nodes"] = json::array();
+    j["focus"] = focus;
+
+    return j;
+}
+
+// run a received message, the reply is sent with the same type
+std::string I3IPC::run(const uint32_t type, const std::string &payload,
+                       IPCClient *client) {
+    Server *server = ipc->server;
+
+    wlr_log(WLR_INFO, "received i3 message of type %u", type);
+
+    switch (type) {
+    case I3_MESSAGE_RUN_COMMAND: {
+        json j = json::array();
+        j.push_back({
+            {"success", false},
+            {"parse_error", true},
+            {"error", "commands are not supported"},
+        });
+        return j.dump();
+    }
+    case I3_MESSAGE_GET_WORKSPACES: {
+        json j = json::array();
+
+        Output *o;
+        wl_list_for_each(o, &server->output_manager->outputs, link) {
+            for (Workspace *w : workspaces(o))
+                j.push_back(workspace(server, w, false));
+        }
+
+        return j.dump();
+    }
+    case I3_MESSAGE_SUBSCRIBE: {
+        const json names = json::parse(payload, nullptr, false);
+        if (!names.is_array())
+            return R"({"success":false})";
+
+        uint32_t events = 0;
+        for (const json &name : names) {
+            if (!name.is_string())
+                return R"({"success":false})";
+
+            const std::string event = name.get<std::string>();
+            if (event == "workspace")
+                events |= IPC_EVENT_WORKSPACE;
+            else if (event == "window")
+                events |= IPC_EVENT_FOCUS | IPC_EVENT_TOPLEVEL;
+            else if (event == "output")
+                events |= IPC_EVENT_OUTPUT;
+            else if (event != "mode" && event != "barconfig_update" &&
+                     event != "binding" && event != "shutdown" &&
+                     event != "tick" && event != "bar_state_update" &&
+                     event != "input")
+                // known events that never happen are accepted
+                return R"({"success":false})";
+        }
+
+        // remember the workspace the next workspace event moves away from
+        if (events & IPC_EVENT_WORKSPACE)
+            if (Output *focused = server->focused_output())
+                focused_workspace =
+                    workspace(server, focused->get_active(), true).dump();
+
+        client->subscriptions |= events;
+        return R"({"success":true})";
+    }
+    case I3_MESSAGE_GET_OUTPUTS: {
+        json j = json::array();
+
+        Output *o;
+        wl_list_for_each(o, &server->output_manager->outputs, link)
+            j.push_back(output(server, o, false));
+
+        return j.dump();
+    }
+    case I3_MESSAGE_GET_TREE: {
+        json nodes = json::array();
+        json focus = json::array();
+        wlr_box box{};
+
+        if (Output *focused = server->focused_output())
+            focus.push_back(focused->id);
+
+        Output *o;
+        wl_list_for_each(o, &server->output_manager->outputs, link) {
+            nodes.push_back(output(server, o, true));
+
+            if (o != server->focused_output())
+                focus.push_back(o->id);
+
+            // the root spans every output
+            const wlr_box &g = o->layout_geometry;
+            if (nodes.size() == 1) {
+                box = g;
+                continue;
+            }
+
+            const int x2 = std::max(box.x + box.width, g.x + g.width);
+            const int y2 = std::max(box.y + box.height, g.y + g.height);
+            box.x = std::min(box.x, g.x);
+            box.y = std::min(box.y, g.y);
+            box.width = x2 - box.x;
+            box.height = y2 - box.y;
+        }
+
+        return json{
+            {"id", root_id},
+            {"type", "root"},
+            {"name", "root"},
+            {"rect", rect(box)},
+            {"focused", false},
+            {"layout", "splith"},
+            {"nodes", nodes},
+            {"floating_nodes", json::array()},
+            {"focus", focus},
+        }
+            .dump();
+    }
+    case I3_MESSAGE_GET_VERSION:
+        return json{
+            {"major", 4},
+            {"minor", 0},
+            {"patch", 0},
+            {"human_readable", "awm"},
+            {"loaded_config_file_name", server->config->path},
+        }
+            .dump();
+    case I3_MESSAGE_GET_BINDING_MODES:
+        return R"(["default"])";
+    case I3_MESSAGE_GET_BINDING_STATE:
+        return R"({"name":"default"})";
+    case I3_MESSAGE_GET_CONFIG:
+        return R"({"config":""})";
+    case I3_MESSAGE_SEND_TICK:
+        return R"({"success":true})";
+    case I3_MESSAGE_GET_MARKS:
+    case I3_MESSAGE_GET_BAR_CONFIG:
+    case I3_MESSAGE_GET_INPUTS:
+    case I3_MESSAGE_GET_SEATS:
+        return "[]";
+    default:
+        return R"({"success":false})";
+    }
+}
+
+// returns true if any i3 client is subscribed to one of the events
+bool I3IPC::subscribed(const uint32_t events) const {
+    IPCClient *client;
+    wl_list_for_each(client, &ipc->clients, link) {
+        if (client->protocol == IPC_CLIENT_PROTOCOL_I3 &&
+            client->subscriptions & events)
+            return true;
+    }
+
+    return false;
+}
+
+// record a window event, containers are built now as the toplevel may be
+// gone once events are sent
+void I3IPC::notify_toplevel(const std::string &change, Toplevel *toplevel) {
+    if (!subscribed(IPC_EVENT_TOPLEVEL))
+        return;
+
+    // awm change names to i3 ones
+    const std::string name = change == "map"     ? "new"
+                             : change == "unmap" ? "close"
+                                                 : change;
+
+    window_changes.push_back(
+        json{{"change", name},
+             {"container",
+              container(toplevel, toplevel == focused_toplevel(ipc->server))}}
+            .dump());
+}
+
+// send the pending events to subscribed i3 clients
+void I3IPC::send_events(const uint32_t events) {
+    std::vector<std::string> windows;
+    windows.swap(window_changes);
+
+    if (!subscribed(events))
+        return;
+
+    Server *server = ipc->server;
+    Output *focused = server->focused_output();
+
+    // messages are built on first use
+    std::string workspace_event, focus_event, output_event;
+
+    if (events & IPC_EVENT_WORKSPACE && focused) {
+        const std::string current =
+            workspace(server, focused->get_active(), true).dump();
+
+        workspace_event = R"({"change":"focus","current":)" + current +
+                          R"(,"old":)" + focused_workspace + "}";
+        focused_workspace = current;
+    }
+
+    if (events & IPC_EVENT_FOCUS)
+        if (Toplevel *toplevel = focused_toplevel(server))
+            focus_event = json{{"change", "focus"},
+                               {"container", container(toplevel, true)}}
+                              .dump();
+
+    if (events & IPC_EVENT_OUTPUT)
+        output_event = R"({"change":"unspecified"})";
+
+    // send to each subscriber
+    IPCClient *client, *tmp;
+    wl_list_for_each_safe(client, tmp, &ipc->clients, link) {
+        if (client->protocol != IPC_CLIENT_PROTOCOL_I3)
+            continue;
+
+        const uint32_t wanted = events & client->subscriptions;
+        if (!wanted)
+            continue;
+
+        if (wanted & IPC_EVENT_WORKSPACE && !workspace_event.empty())
+            client->send(I3_EVENT_WORKSPACE, workspace_event);
+        if (wanted & IPC_EVENT_TOPLEVEL)
+            for (const std::string &window : windows)
+                client->send(I3_EVENT_WINDOW, window);
+        if (wanted & IPC_EVENT_FOCUS && !focus_event.empty())
+            client->send(I3_EVENT_WINDOW, focus_event);
+        if (wanted & IPC_EVENT_OUTPUT)
+            client->send(I3_EVENT_OUTPUT, output_event);
+
+        if (!client->flush())
+            delete client;
+    }
+}
+
+I3IPC::~I3IPC() {
+    // stop accepting connections
+    if (event_source)
+        wl_event_source_remove(event_source);
+
+    // close
+    if (fd != -1)
+        close(fd);
+
+    // unlink
+    if (unlink(path.c_str()))
+        wlr_log(WLR_ERROR, "failed to unlink i3 IPC socket at path `%s`",
+                path.c_str());
+}
@@ -5,8 +5,15 @@
 using json = nlohmann::json;
 
 IPC::IPC(Server *server) : server(server) {
+    wl_list_init(&clients);
+
+    // socket path override, exported for clients started by awm
+    if (const char *env = getenv("AWMSOCK"))
+        path = env;
+    setenv("AWMSOCK", path.c_str(), true);
+
     // create file descriptor
-    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (fd == -1) {
         wlr_log(WLR_ERROR, "%s", "failed to create IPC socket");
         return;
@@ -31,55 +38,546 @@ IPC::IPC(Server *server) : server(server) {
     }
 
     // listen for connections
-    if (listen(fd, 5) == -1) {
+    if (listen(fd, SOMAXCONN) == -1) {
         wlr_log(WLR_ERROR,
                 "failed to listen on socket with fd `%d` on path `%s`", fd,
                 path.c_str());
         return;
     }
 
-    // start thread
-    thread = std::thread([&]() {
-        while (running) {
-            // accept connections
-            int client_fd = accept(fd, nullptr, nullptr);
-            if (client_fd == -1) {
-                wlr_log(WLR_ERROR,
-                        "failed to accept connection on socket with fd `%d` on "
-                        "path `%s`",
-                        fd, path.c_str());
-                continue;
-            }
+    // accept connections on the compositor event loop
+    event_source = wl_event_loop_add_fd(
+        wl_display_get_event_loop(server->display), fd, WL_EVENT_READABLE,
+        [](int fd, [[maybe_unused]] uint32_t mask, void *data) {
+            IPC *ipc = static_cast<IPC *>(data);
+
+            // accept every pending connection
+            int client_fd;
+            while ((client_fd = accept4(fd, nullptr, nullptr,
+                                        SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+                new IPCClient(ipc, client_fd);
 
-            // read from client
-            char buffer[1024];
-            int len = read(client_fd, buffer, sizeof(buffer));
-            if (len == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
                 wlr_log(WLR_ERROR,
-                        "failed to read from client with fd `%d` on path `%s`",
-                        client_fd, path.c_str());
-                close(client_fd);
-                continue;
+                        "failed to accept connection on socket with fd `%d` "
+                        "on path `%s`",
+                        fd, ipc->path.c_str());
+
+            return 0;
+        },
+        this);
+}
+
+// split a comma separated list of fields, empty for all fields
+static std::vector<std::string> parse_fields(const std::string &fields) {
+    std::vector<std::string> names;
+    std::stringstream ss(fields);
+    std::string name;
+
+    while (std::getline(ss, name, ','))
+        if (!name.empty())
+            names.push_back(name);
+
+    return names;
+}
+
+// keep only the requested fields of an entry
+static void project(json &entry, const std::vector<std::string> &fields) {
+    if (fields.empty())
+        return;
+
+    for (auto it = entry.begin(); it != entry.end();)
+        if (std::find(fields.begin(), fields.end(), it.key()) == fields.end())
+            it = entry.erase(it);
+        else
+            ++it;
+}
+
+// serve a listing from its cache, building it if missing or stale
+template <typename Build>
+static const std::string &cached(IPCCache &cache, Output *output,
+                                 const std::string &fields, Build build) {
+    // listings depending on the focused output are rebuilt when it changes
+    if (cache.dirty || cache.output != output) {
+        cache.replies.clear();
+        cache.dirty = false;
+        cache.output = output;
+    }
+
+    auto it = cache.replies.find(fields);
+    if (it == cache.replies.end())
+        it = cache.replies.emplace(fields, build(parse_fields(fields)).dump())
+                 .first;
+
+    return it->second;
+}
+
+// build the output list
+static json output_list(Server *server,
+                        const std::vector<std::string> &fields = {}) {
+    json j = json::object();
+
+    Output *output, *tmp;
+    wl_list_for_each_safe(output, tmp, &server->output_manager->outputs, link) {
+        json entry = {
+            {"x", output->layout_geometry.x},
+            {"y", output->layout_geometry.y},
+            {"width", output->layout_geometry.width},
+            {"height", output->layout_geometry.height},
+            {"refresh", output->wlr_output->refresh / 1000.0},
+            {"scale", output->wlr_output->scale},
+            {"transform", output->wlr_output->transform},
+            {"adaptive", output->wlr_output->adaptive_sync_supported},
+            {"enabled", output->wlr_output->enabled},
+            {"focused", output == server->focused_output()},
+            {"workspace", output->get_active()->num},
+        };
+
+        // below values may be null
+        if (output->wlr_output->description)
+            entry["description"] = output->wlr_output->description;
+
+        if (output->wlr_output->make)
+            entry["make"] = output->wlr_output->make;
+
+        if (output->wlr_output->model)
+            entry["model"] = output->wlr_output->model;
+
+        if (output->wlr_output->serial)
+            entry["serial"] = output->wlr_output->serial;
+
+        project(entry, fields);
+        j[output->wlr_output->name] = entry;
+    }
+
+    return j;
+}
+
+// build the workspace list of an output, fields apply to both workspaces and
+// their toplevels
+static json workspace_list(Output *output,
+                           const std::vector<std::string> &fields) {
+    json j = json::array();
+
+    if (!output)
+        return j;
+
+    Workspace *workspace, *tmp;
+    wl_list_for_each_safe(workspace, tmp, &output->workspaces, link) {
+        json toplevels = json::object();
+
+        Toplevel *toplevel, *tmp1;
+        wl_list_for_each_safe(toplevel, tmp1, &workspace->toplevels, link) {
+            json entry = {
+                {"title", toplevel->title()},
+                {"x", toplevel->geometry.x},
+                {"y", toplevel->geometry.y},
+                {"width", toplevel->geometry.width},
+                {"height", toplevel->geometry.height},
+                {"focused", toplevel == workspace->active_toplevel},
+            };
+
+            project(entry, fields);
+            toplevels[std::to_string(toplevel->id)] = entry;
+        }
+
+        json entry = {
+            {"number", workspace->num + 1},
+            {"focused", workspace == output->get_active()},
+        };
+
+        if (!toplevels.empty())
+            entry["toplevels"] = toplevels;
+
+        project(entry, fields);
+        j[workspace->num] = entry;
+    }
+
+    return j;
+}
+
+// name of a scanout result in IPC responses
+static const char *scanout_name(const OutputScanout scanout) {
+    switch (scanout) {
+    case OUTPUTSCANOUT_DIRECT:
+        return "direct";
+    case OUTPUTSCANOUT_FORMAT:
+        return "format";
+    case OUTPUTSCANOUT_OCCLUSION:
+        return "occlusion";
+    case OUTPUTSCANOUT_SCALE:
+        return "scale";
+    case OUTPUTSCANOUT_TRANSFORM:
+        return "transform";
+    case OUTPUTSCANOUT_CURSOR:
+        return "cursor";
+    default:
+        return "none";
+    }
+}
+
+// build the list of every toplevel
+static json toplevel_list(Server *server,
+                          const std::vector<std::string> &fields) {
+    json j = json::object();
+
+    Output *o, *t0;
+    Workspace *w, *t1;
+    Toplevel *t, *t2;
+
+    wl_list_for_each_safe(o, t0, &server->output_manager->outputs, link)
+        wl_list_for_each_safe(w, t1, &o->workspaces, link) {
+        wl_list_for_each_safe(t, t2, &w->toplevels, link) {
+            json entry = {
+                {"title", t->title()},
+                {"x", t->geometry.x},
+                {"y", t->geometry.y},
+                {"width", t->geometry.width},
+                {"height", t->geometry.height},
+                {"focused", t == w->active_toplevel},
+                {"hidden", t->hidden},
+                {"maximized", t->maximized()},
+                {"fullscreen", t->fullscreen()},
+#ifdef XWAYLAND
+                {"xwayland", !t->xdg_toplevel},
+#endif
+            };
+
+            project(entry, fields);
+            j[std::to_string(t->id)] = entry;
+        }
+    }
+
+    return j;
+}
+
+// resolve a token to the command name it spells out or abbreviates, returns
+// nullptr with an error if the abbreviation fits more than one name
+static const char *resolve(const std::string &token,
+                           const std::initializer_list<const char *> names,
+                           std::string *error) {
+    const char *match = nullptr;
+    std::string candidates;
+    uint32_t count = 0;
+
+    for (const char *name : names) {
+        // a full name wins over abbreviations of longer ones
+        if (token == name)
+            return name;
+
+        if (token.empty() ||
+            std::string_view(name).substr(0, token.size()) != token)
+            continue;
+
+        candidates += (count++ ? ", " : "") + std::string(name);
+        match = name;
+    }
+
+    if (count > 1) {
+        *error = "ambiguous command '" + token + "': " + candidates;
+        return nullptr;
+    }
+
+    return match;
+}
+
+// parse an unsigned number, returns false if the token is not one
+static bool parse_number(const std::string &token, uint64_t *value) {
+    if (token.empty() || !isdigit(token[0]))
+        return false;
+
+    char *end;
+    errno = 0;
+    *value = strtoull(token.c_str(), &end, 10);
+    return !errno && !*end;
+}
+
+// summary of a latency histogram, in microseconds
+static json histogram_json(const Histogram &histogram) {
+    if (!histogram.count)
+        return {{"count", 0}};
+
+    // non-empty buckets as [lower bound, count]
+    json buckets = json::array();
+    for (uint32_t i = 0; i != HISTOGRAM_BUCKETS; ++i)
+        if (histogram.buckets[i])
+            buckets.push_back(
+                {Histogram::bucket_min(i), histogram.buckets[i]});
+
+    return {{"count", histogram.count},
+            {"min", histogram.min},
+            {"mean", histogram.sum / histogram.count},
+            {"p50", histogram.percentile(0.5)},
+            {"p90", histogram.percentile(0.9)},
+            {"p99", histogram.percentile(0.99)},
+            {"p999", histogram.percentile(0.999)},
+            {"max", histogram.max},
+            {"buckets", buckets}};
+}
+
+// find a mapped toplevel by id
+static Toplevel *find_toplevel(Server *server, const uint64_t id) {
+    const auto it = server->toplevels.find(id);
+    if (it == server->toplevels.end() || !it->second->workspace)
+        return nullptr;
+
+    return it->second;
+}
+
+// find an output by name
+static Output *find_output(Server *server, const std::string &name) {
+    Output *o;
+    wl_list_for_each(o, &server->output_manager->outputs, link) {
+        if (name == o->wlr_output->name)
+            return o;
+    }
+
+    return nullptr;
+}
+
+// parse a mutating command, returns 1 if parsed, 0 if the command is not a
+// mutating one and -1 with an error if it is invalid
+int IPC::parse_action(const std::string &command, IPCAction *action,
+                      std::string *error) const {
+    std::vector<std::string> tokens;
+    std::stringstream ss(command);
+    std::string token;
+    while (ss >> token)
+        tokens.push_back(token);
+
+    if (tokens.size() < 2)
+        return 0;
+
+    const char group = tokens[0][0];
+    const std::string &name = tokens[1];
+
+    // resolve the toplevel id at index i
+    auto toplevel = [&](const size_t i, Toplevel **result) {
+        uint64_t id;
+        if (i >= tokens.size() || !parse_number(tokens[i], &id)) {
+            *error = "expected a toplevel id";
+            return false;
+        }
+
+        if (!((*result = find_toplevel(server, id)))) {
+            *error = "no toplevel with id " + tokens[i];
+            return false;
+        }
+
+        return true;
+    };
+
+    // resolve the 1-based workspace number at index i of an output, the
+    // workspace active when the action runs if missing and optional is set
+    auto workspace = [&](const size_t i, Output *output, const bool optional) {
+        if (!output) {
+            *error = "no such output";
+            return false;
+        }
+
+        if (i >= tokens.size() && optional) {
+            action->output = output;
+            return true;
+        }
+
+        uint64_t n;
+        if (i >= tokens.size() || !parse_number(tokens[i], &n) || !n) {
+            *error = "expected a workspace number";
+            return false;
+        }
+
+        if (!((action->workspace = output->get_workspace(n - 1)))) {
+            *error = "no workspace " + tokens[i] + " on output " +
+                     output->wlr_output->name;
+            return false;
+        }
+
+        return true;
+    };
+
+    // the output named at index i, the focused one if missing
+    auto output = [&](const size_t i) {
+        return i < tokens.size() ? find_output(server, tokens[i])
+                                 : server->focused_output();
+    };
+
+    // optional on, off or toggle at index i
+    auto state = [&](const size_t i) {
+        if (i >= tokens.size() || tokens[i] == "toggle")
+            action->state = IPC_ACTION_TOGGLE;
+        else if (tokens[i] == "on")
+            action->state = IPC_ACTION_ON;
+        else if (tokens[i] == "off")
+            action->state = IPC_ACTION_OFF;
+        else {
+            *error = "expected on, off or toggle";
+            return false;
+        }
+
+        return true;
+    };
+
+    // the full or unambiguous command name within a group
+    const char *command_name = nullptr;
+    if (group == 't')
+        command_name = resolve(name,
+                               {"focus", "close", "swap", "move", "fullscreen",
+                                "maximize"},
+                               error);
+    else if (group == 'w')
+        command_name = resolve(name, {"set", "tile"}, error);
+
+    if (!command_name)
+        return error->empty() ? 0 : -1;
+
+    const std::string_view command_view = command_name;
+    if (command_view == "focus") {
+        action->type = IPC_ACTION_FOCUS;
+        return toplevel(2, &action->toplevel) ? 1 : -1;
+    } else if (command_view == "close") {
+        action->type = IPC_ACTION_CLOSE;
+        return toplevel(2, &action->toplevel) ? 1 : -1;
+    } else if (command_view == "swap") {
+        action->type = IPC_ACTION_SWAP;
+        return toplevel(2, &action->toplevel) && toplevel(3, &action->other)
+                   ? 1
+                   : -1;
+    } else if (command_view == "move") {
+        action->type = IPC_ACTION_MOVE;
+        if (!toplevel(2, &action->toplevel))
+            return -1;
+
+        // workspaces of the toplevel's output
+        Workspace *current = server->get_workspace(action->toplevel);
+        return workspace(3, current->output, false) ? 1 : -1;
+    } else if (command_view == "fullscreen") {
+        action->type = IPC_ACTION_FULLSCREEN;
+        return toplevel(2, &action->toplevel) && state(3) ? 1 : -1;
+    } else if (command_view == "maximize") {
+        action->type = IPC_ACTION_MAXIMIZE;
+        return toplevel(2, &action->toplevel) && state(3) ? 1 : -1;
+    } else if (command_view == "set") {
+        action->type = IPC_ACTION_WORKSPACE;
+        return workspace(2, output(3), false) ? 1 : -1;
+    } else if (command_view == "tile") {
+        action->type = IPC_ACTION_TILE;
+        return workspace(2, output(3), true) ? 1 : -1;
+    }
+
+    return 0;
+}
+
+// run a batch of mutating commands, nothing runs unless every command is
+// valid and all of them run in this event loop iteration, so clients see a
+// single relayout
+std::string IPC::run_actions(const std::vector<std::string> &commands) {
+    std::vector<IPCAction> actions;
+
+    for (size_t i = 0; i != commands.size(); ++i) {
+        IPCAction action{};
+        std::string error;
+
+        if (parse_action(commands[i], &action, &error) != 1)
+            return json{{"success", false},
+                        {"command", i},
+                        {"error", error.empty() ? "not a mutating command"
+                                                : error}}
+                .dump();
+
+        actions.push_back(action);
+    }
+
+    // workspace switches and tiling are deferred, every output switches at
+    // most once and every workspace is tiled at most once, after everything
+    // else moved
+    std::vector<Workspace *> shown;
+    std::vector<Workspace *> tiled;
+
+    // the workspace an output shows once the batch is done
+    auto active = [&](Output *output) {
+        for (Workspace *w : shown)
+            if (w->output == output)
+                return w;
+
+        return output->get_active();
+    };
+
+    // show a workspace once the batch is done, replacing an earlier switch
+    auto show = [&](Workspace *workspace) {
+        for (Workspace *&w : shown)
+            if (w->output == workspace->output) {
+                w = workspace;
+                return;
             }
 
-            // run command
-            std::string response = run(std::string(buffer, len));
+        shown.push_back(workspace);
+    };
 
-            // write response to client
-            if (write(client_fd, response.c_str(), strlen(response.c_str())) ==
-                -1)
-                wlr_log(WLR_ERROR,
-                        "failed to write to client with fd `%d` on path `%s`",
-                        client_fd, path.c_str());
+    for (const IPCAction &action : actions) {
+        Toplevel *toplevel = action.toplevel;
+
+        // earlier commands may have changed the active workspace
+        Workspace *workspace =
+            action.output ? active(action.output) : action.workspace;
+
+        // earlier commands may have moved the toplevel
+        Workspace *current =
+            toplevel ? server->get_workspace(toplevel) : nullptr;
+        if (toplevel && !current)
+            continue;
 
-            // close connection
-            close(client_fd);
+        switch (action.type) {
+        case IPC_ACTION_FOCUS:
+            // show the workspace holding the toplevel, a hidden one focuses
+            // its active toplevel once shown
+            show(current);
+            if (current == current->output->get_active())
+                current->focus_toplevel(toplevel);
+            else
+                current->active_toplevel = toplevel;
+            break;
+        case IPC_ACTION_CLOSE:
+            current->close(toplevel);
+            break;
+        case IPC_ACTION_SWAP:
+            current->swap(toplevel, action.other);
+            break;
+        case IPC_ACTION_MOVE:
+            current->move_to(toplevel, workspace);
+            break;
+        case IPC_ACTION_WORKSPACE:
+            show(workspace);
+            break;
+        case IPC_ACTION_TILE:
+            if (std::find(tiled.begin(), tiled.end(), workspace) ==
+                tiled.end())
+                tiled.push_back(workspace);
+            break;
+        case IPC_ACTION_FULLSCREEN:
+            toplevel->set_fullscreen(action.state == IPC_ACTION_TOGGLE
+                                         ? !toplevel->fullscreen()
+                                         : action.state == IPC_ACTION_ON);
+            break;
+        case IPC_ACTION_MAXIMIZE:
+            toplevel->set_maximized(action.state == IPC_ACTION_TOGGLE
+                                        ? !toplevel->maximized()
+                                        : action.state == IPC_ACTION_ON);
+            break;
         }
-    });
+    }
+
+    for (Workspace *workspace : shown)
+        if (workspace != workspace->output->get_active())
+            workspace->output->set_workspace(workspace->num);
+
+    for (Workspace *workspace : tiled)
+        workspace->tile();
+
+    return R"({"success":true})";
 }
 
 // run a received command
-std::string IPC::run(std::string command) {
+std::string IPC::run(std::string command, IPCClient *client) {
     std::string response;
     std::string token;
     std::stringstream ss(command);
@@ -87,49 +585,33 @@ std::string IPC::run(std::string command) {
 
     wlr_log(WLR_INFO, "received command `%s`", command.c_str());
 
+    // mutating commands, several of them are separated by `;`
+    std::vector<std::string> commands;
+    std::stringstream batch(command);
+    while (std::getline(batch, token, ';'))
+        if (token.find_first_not_of(" \t\n") != std::string::npos)
+            commands.push_back(token);
+
+    IPCAction action{};
+    std::string error;
+    if (commands.size() > 1 ||
+        (commands.size() == 1 && parse_action(commands[0], &action, &error)))
+        return run_actions(commands);
+
     if (std::getline(ss, token, ' ')) {
         if (token[0] == 'e') // exit
             server->exit();
         else if (token[0] == 'o') { // output
             if (std::getline(ss, token, ' ')) {
                 if (token[0] == 'l') { // output list
-                    Output *output, *tmp;
-                    wl_list_for_each_safe(
-                        output, tmp, &server->output_manager->outputs, link) {
-                        j[output->wlr_output->name] = {
-                            {"x", output->layout_geometry.x},
-                            {"y", output->layout_geometry.y},
-                            {"width", output->layout_geometry.width},
-                            {"height", output->layout_geometry.height},
-                            {"refresh", output->wlr_output->refresh / 1000.0},
-                            {"scale", output->wlr_output->scale},
-                            {"transform", output->wlr_output->transform},
-                            {"adaptive",
-                             output->wlr_output->adaptive_sync_supported},
-                            {"enabled", output->wlr_output->enabled},
-                            {"focused", output == server->focused_output()},
-                            {"workspace", output->get_active()->num},
-                        };
-
-                        // below values may be null
-                        if (output->wlr_output->description)
-                            j[output->wlr_output->name]["description"] =
-                                output->wlr_output->description;
-
-                        if (output->wlr_output->make)
-                            j[output->wlr_output->name]["make"] =
-                                output->wlr_output->make;
+                    std::string fields;
+                    std::getline(ss, fields, ' ');
 
-                        if (output->wlr_output->model)
-                            j[output->wlr_output->name]["model"] =
-                                output->wlr_output->model;
-
-                        if (output->wlr_output->serial)
-                            j[output->wlr_output->name]["serial"] =
-                                output->wlr_output->serial;
-                    }
-
-                    response = j.dump();
+                    response = cached(outputs, server->focused_output(),
+                                      fields,
+                                      [&](const std::vector<std::string> &f) {
+                                          return output_list(server, f);
+                                      });
                 } else if (token[0] == 'm') { // output modes
                     Output *output, *tmp;
                     wl_list_for_each_safe(
@@ -149,74 +631,192 @@ std::string IPC::run(std::string command) {
                         }
                     }
 
+                    response = j.dump();
+                } else if (token[0] == 'f') { // output frames
+                    j = json::object();
+
+                    Output *output;
+                    wl_list_for_each(output, &server->output_manager->outputs,
+                                     link) {
+                        // frame done delays of the toplevels held back,
+                        // read live since they change every frame
+                        json delays = json::object();
+                        for (const auto &[id, toplevel] : server->toplevels)
+                            if (toplevel->output == output &&
+                                toplevel->frame_delay)
+                                delays[std::to_string(id)] =
+                                    toplevel->frame_delay;
+
+                        j[output->wlr_output->name] = {
+                            {"committed", output->frames_committed},
+                            {"skipped", output->frames_skipped},
+                            {"failed", output->frames_failed},
+                            {"torn", output->frames_torn},
+                            {"render_delay_us",
+                             output->last_render_delay / 1000},
+                            {"render_time_max_us",
+                             *std::max_element(output->render_times.begin(),
+                                               output->render_times.end()) /
+                                 1000},
+                            {"frame_delay_ms", delays},
+                        };
+                    }
+
+                    response = j.dump();
+                } else if (token[0] == 's') { // output scanout
+                    j = json::object();
+
+                    Output *output;
+                    wl_list_for_each(output, &server->output_manager->outputs,
+                                     link) {
+                        json frames = json::object();
+                        for (int i = OUTPUTSCANOUT_DIRECT;
+                             i != OUTPUTSCANOUT_COUNT; ++i) {
+                            const auto scanout = static_cast<OutputScanout>(i);
+                            frames[scanout_name(scanout)] =
+                                output->scanout_frames[i];
+                        }
+
+                        j[output->wlr_output->name] = {
+                            {"last", scanout_name(output->scanout)},
+                            {"frames", frames},
+                        };
+                    }
+
                     response = j.dump();
                 }
             }
         } else if (token[0] == 'w') { // workspace
             if (std::getline(ss, token, ' ')) {
                 if (token[0] == 'l') { // workspace list
-                    Output *output = server->focused_output();
-                    json j;
+                    std::string fields;
+                    std::getline(ss, fields, ' ');
 
-                    Workspace *workspace, *tmp;
-                    wl_list_for_each_safe(workspace, tmp, &output->workspaces,
-                                          link) {
-                        Toplevel *toplevel, *tmp1;
-
-                        j[workspace->num]["number"] =
-                            workspace->num+1;
-
-                        j[workspace->num]["focused"] =
-                            workspace == output->get_active();
-
-                        wl_list_for_each_safe(toplevel, tmp1,
-                                              &workspace->toplevels, link) {
-                            j[workspace->num]["toplevels"]
-                             [string_format("%p", toplevel)] = {
-                                 {"title", toplevel->title()},
-                                 {"x", toplevel->geometry.x},
-                                 {"y", toplevel->geometry.y},
-                                 {"width", toplevel->geometry.width},
-                                 {"height", toplevel->geometry.height},
-                                 {"focused",
-                                  toplevel == workspace->active_toplevel},
-                             };
-                        }
-                    }
-
-                    response = j.dump();
+                    Output *output = server->focused_output();
+                    response = cached(workspaces, output, fields,
+                                      [&](const std::vector<std::string> &f) {
+                                          return workspace_list(output, f);
+                                      });
                 }
             }
         } else if (token[0] == 't') { // toplevel
             if (std::getline(ss, token, ' ')) {
                 if (token[0] == 'l') { // toplevel list
-                    Output *o, *t0;
-                    Workspace *w, *t1;
-                    Toplevel *t, *t2;
-                    json j;
+                    std::string fields;
+                    std::getline(ss, fields, ' ');
 
-                    wl_list_for_each_safe(
-                        o, t0, &server->output_manager->outputs, link)
-                        wl_list_for_each_safe(w, t1, &o->workspaces, link) {
-                        wl_list_for_each_safe(t, t2, &w->toplevels, link) {
-                            j[string_format("%p", t)] = {
-                                {"title", t->title()},
-                                {"x", t->geometry.x},
-                                {"y", t->geometry.y},
-                                {"width", t->geometry.width},
-                                {"height", t->geometry.height},
-                                {"focused", t == w->active_toplevel},
-                                {"hidden", t->hidden},
-                                {"maximized", t->maximized()},
-                                {"fullscreen", t->fullscreen()},
-#ifdef XWAYLAND
-                                {"xwayland", !t->xdg_toplevel},
-#endif
-                            };
-                        }
-                    }
+                    response = cached(toplevels, nullptr, fields,
+                                      [&](const std::vector<std::string> &f) {
+                                          return toplevel_list(server, f);
+                                      });
+                }
+            }
+        } else if (token[0] == 's') { // subscribe
+            uint32_t events = 0;
+
+            // no event names subscribes to everything
+            while (std::getline(ss, token, ' ')) {
+                if (token.empty())
+                    continue;
+
+                switch (token[0]) {
+                case 'f':
+                    events |= IPC_EVENT_FOCUS;
+                    break;
+                case 'w':
+                    events |= IPC_EVENT_WORKSPACE;
+                    break;
+                case 't':
+                    events |= IPC_EVENT_TOPLEVEL;
+                    break;
+                case 'o':
+                    events |= IPC_EVENT_OUTPUT;
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            if (!events)
+                events = IPC_EVENT_ALL;
+
+            if (client)
+                client->subscriptions |= events;
+
+            json j = json::array();
+            if (events & IPC_EVENT_FOCUS)
+                j.push_back("focus");
+            if (events & IPC_EVENT_WORKSPACE)
+                j.push_back("workspace");
+            if (events & IPC_EVENT_TOPLEVEL)
+                j.push_back("toplevel");
+            if (events & IPC_EVENT_OUTPUT)
+                j.push_back("output");
+
+            response = json{{"subscribed", j}}.dump();
+        } else if (token[0] == 'p') { // state page
+            if (client && (state || create_state())) {
+                // one eventfd per connection, closed with it
+                if (client->state_eventfd == -1)
+                    client->state_eventfd =
+                        eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+                if (client->state_eventfd != -1) {
+                    client->attach_state = true;
+                    response = json{{"size", sizeof(IPCState)},
+                                    {"version", IPC_STATE_VERSION}}
+                                   .dump();
+                } else
+                    wlr_log(WLR_ERROR, "%s",
+                            "failed to create IPC state eventfd");
+            }
+        } else if (token[0] == 'i') { // input
+            if (std::getline(ss, token, ' ')) {
+                if (token[0] == 'p') { // pointer
+                    const Cursor *cursor = server->cursor;
+
+                    j = {{"locked", cursor->locked},
+                         {"motion_events", cursor->motion_events},
+                         {"locked_motion_events",
+                          cursor->locked_motion_events}};
+
+                    response = j.dump();
+                } else if (token[0] == 'l') { // latency list
+                    j = json::object();
+                    for (const auto &[name, stats] : server->input_stats)
+                        j[name] = {{"key", histogram_json(stats.key)},
+                                   {"motion", histogram_json(stats.motion)},
+                                   {"button", histogram_json(stats.button)}};
+
+                    response = j.dump();
+                } else if (token[0] == 'e') { // input to present latency
+                    json outputs = json::object();
+                    Output *output;
+                    wl_list_for_each(output, &server->output_manager->outputs,
+                                     link)
+                        outputs[output->wlr_output->name] =
+                            histogram_json(output->present_latency);
+
+                    json applications = json::object();
+                    for (const auto &[app_id, histogram] :
+                         server->present_latency)
+                        applications[app_id] = histogram_json(histogram);
+
+                    j = {{"outputs", outputs},
+                         {"applications", applications}};
 
                     response = j.dump();
+                } else if (token[0] == 'r') { // latency reset
+                    for (auto &[name, stats] : server->input_stats)
+                        stats.reset();
+
+                    server->present_latency.clear();
+                    Output *output;
+                    wl_list_for_each(output, &server->output_manager->outputs,
+                                     link)
+                        output->present_latency.reset();
+
+                    response = R"({"success":true})";
                 }
             }
         } else if (token[0] == 'k') { // keyboard
@@ -304,16 +904,346 @@ std::string IPC::run(std::string command) {
     return response;
 }
 
+// returns true if any client is subscribed to one of the events
+bool IPC::subscribed(const uint32_t events) const {
+    IPCClient *client;
+    wl_list_for_each(client, &clients, link) {
+        if (client->subscriptions & events)
+            return true;
+    }
+
+    return false;
+}
+
+// queue events for subscribers, sent once the event loop is idle so a burst
+// of changes results in a single message per event
+void IPC::notify(const uint32_t events) {
+    // mark the listings showing this state as stale
+    uint32_t snapshots = 0;
+    if (events & IPC_EVENT_FOCUS)
+        snapshots |= IPC_SNAPSHOT_WORKSPACES | IPC_SNAPSHOT_TOPLEVELS;
+    if (events & IPC_EVENT_WORKSPACE)
+        snapshots |= IPC_SNAPSHOT_OUTPUTS | IPC_SNAPSHOT_WORKSPACES;
+    if (events & IPC_EVENT_TOPLEVEL)
+        snapshots |= IPC_SNAPSHOT_WORKSPACES | IPC_SNAPSHOT_TOPLEVELS;
+    if (events & IPC_EVENT_OUTPUT)
+        snapshots |= IPC_SNAPSHOT_OUTPUTS;
+    invalidate(snapshots);
+
+    if (!subscribed(events))
+        return;
+
+    pending_events |= events;
+    schedule();
+}
+
+// send pending events and update the state page once the event loop is idle
+void IPC::schedule() {
+    // already scheduled
+    if (idle_source)
+        return;
+
+    idle_source = wl_event_loop_add_idle(
+        wl_display_get_event_loop(server->display),
+        [](void *data) {
+            IPC *ipc = static_cast<IPC *>(data);
+
+            // idle sources are removed after dispatch
+            ipc->idle_source = nullptr;
+
+            if (ipc->pending_events)
+                ipc->send_events();
+
+            if (ipc->state_dirty)
+                ipc->update_state();
+        },
+        this);
+}
+
+// mark cached listings as stale, they are rebuilt on the next request
+void IPC::invalidate(const uint32_t snapshots) {
+    if (snapshots & IPC_SNAPSHOT_OUTPUTS)
+        outputs.dirty = true;
+    if (snapshots & IPC_SNAPSHOT_WORKSPACES)
+        workspaces.dirty = true;
+    if (snapshots & IPC_SNAPSHOT_TOPLEVELS)
+        toplevels.dirty = true;
+
+    // the state page holds all of them
+    if (state && snapshots) {
+        state_dirty = true;
+        schedule();
+    }
+}
+
+// record a toplevel change for subscribers
+void IPC::notify_toplevel(const std::string &change, Toplevel *toplevel) {
+    if (!subscribed(IPC_EVENT_TOPLEVEL))
+        return;
+
+    if (i3)
+        i3->notify_toplevel(change, toplevel);
+
+    json j = {
+        {"change", change},
+        {"id", std::to_string(toplevel->id)},
+        {"title", toplevel->title()},
+    };
+
+    if (Workspace *workspace = server->get_workspace(toplevel))
+        j["workspace"] = workspace->num;
+
+    toplevel_changes.push_back(j.dump());
+    notify(IPC_EVENT_TOPLEVEL);
+}
+
+// send the pending events to subscribed clients
+void IPC::send_events() {
+    const uint32_t events = pending_events;
+    pending_events = 0;
+
+    // messages are built on first use
+    std::string focus, workspace, toplevel, output;
+
+    if (events & IPC_EVENT_FOCUS) {
+        json j = {{"event", "focus"}, {"output", nullptr},
+                  {"workspace", nullptr}, {"toplevel", nullptr}};
+
+        if (Output *focused = server->focused_output()) {
+            Workspace *active = focused->get_active();
+            j["output"] = focused->wlr_output->name;
+            j["workspace"] = active->num;
+
+            if (Toplevel *t = active->active_toplevel)
+                j["toplevel"] = {
+                    {"id", std::to_string(t->id)},
+                    {"title", t->title()},
+                };
+        }
+
+        focus = j.dump();
+    }
+
+    if (events & IPC_EVENT_WORKSPACE) {
+        json j = {{"event", "workspace"}, {"outputs", json::object()}};
+
+        Output *o;
+        wl_list_for_each(o, &server->output_manager->outputs, link)
+            j["outputs"][o->wlr_output->name] = {
+                {"workspace", o->get_active()->num},
+                {"focused", o == server->focused_output()},
+            };
+
+        workspace = j.dump();
+    }
+
+    if (events & IPC_EVENT_TOPLEVEL) {
+        std::string changes;
+        for (const std::string &change : toplevel_changes)
+            changes += (changes.empty() ? "" : ",") + change;
+        toplevel_changes.clear();
+
+        toplevel = R"({"event":"toplevel","changes":[)" + changes + "]}";
+    }
+
+    if (events & IPC_EVENT_OUTPUT)
+        output = json{{"event", "output"}, {"outputs", output_list(server)}}
+                     .dump();
+
+    // send to each subscriber
+    IPCClient *client, *tmp;
+    wl_list_for_each_safe(client, tmp, &clients, link) {
+        // i3 clients get their own events
+        if (client->protocol == IPC_CLIENT_PROTOCOL_I3)
+            continue;
+
+        const uint32_t wanted = events & client->subscriptions;
+        if (!wanted)
+            continue;
+
+        if (wanted & IPC_EVENT_FOCUS)
+            client->send(IPC_MESSAGE_EVENT, focus);
+        if (wanted & IPC_EVENT_WORKSPACE)
+            client->send(IPC_MESSAGE_EVENT, workspace);
+        if (wanted & IPC_EVENT_TOPLEVEL)
+            client->send(IPC_MESSAGE_EVENT, toplevel);
+        if (wanted & IPC_EVENT_OUTPUT)
+            client->send(IPC_MESSAGE_EVENT, output);
+
+        if (!client->flush())
+            delete client;
+    }
+
+    if (i3)
+        i3->send_events(events);
+}
+
+// copy a string into a fixed size buffer, truncated on a utf-8 boundary
+static void copy_string(char *dest, const size_t size, const char *src) {
+    size_t len = src ? strnlen(src, size) : 0;
+
+    if (len == size) {
+        len = size - 1;
+
+        // drop a partial code point
+        while (len && (src[len] & 0xc0) == 0x80)
+            --len;
+    }
+
+    if (len)
+        memcpy(dest, src, len);
+    dest[len] = '\0';
+}
+
+// create the state page readers map, returns false on failure
+bool IPC::create_state() {
+    state_fd = memfd_create("awm-state", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (state_fd == -1) {
+        wlr_log(WLR_ERROR, "%s", "failed to create IPC state page");
+        return false;
+    }
+
+    void *page = MAP_FAILED;
+    if (ftruncate(state_fd, sizeof(IPCState)) == 0)
+        page = mmap(nullptr, sizeof(IPCState), PROT_READ | PROT_WRITE,
+                    MAP_SHARED, state_fd, 0);
+
+    if (page == MAP_FAILED) {
+        wlr_log(WLR_ERROR, "%s", "failed to map IPC state page");
+        close(state_fd);
+        state_fd = -1;
+        return false;
+    }
+
+    // readers may neither resize nor write to the page
+    int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+#ifdef F_SEAL_FUTURE_WRITE
+    seals |= F_SEAL_FUTURE_WRITE;
+#endif
+    if (fcntl(state_fd, F_ADD_SEALS, seals) == -1)
+        wlr_log(WLR_ERROR, "%s", "failed to seal IPC state page");
+
+    state = new (page) IPCState{};
+    state->magic = IPC_STATE_MAGIC;
+    state->version = IPC_STATE_VERSION;
+
+    update_state();
+    return true;
+}
+
+// write the current state to the state page and wake its readers
+void IPC::update_state() {
+    state_dirty = false;
+
+    // odd while writing
+    const uint32_t sequence = state->sequence.load(std::memory_order_relaxed);
+    state->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Output *focused = server->focused_output();
+    uint32_t output_count = 0, workspace_count = 0, toplevel_count = 0;
+
+    Output *o;
+    wl_list_for_each(o, &server->output_manager->outputs, link) {
+        if (output_count == IPC_STATE_MAX_OUTPUTS)
+            break;
+
+        IPCStateOutput &output = state->outputs[output_count];
+        copy_string(output.name, sizeof(output.name), o->wlr_output->name);
+        output.x = o->layout_geometry.x;
+        output.y = o->layout_geometry.y;
+        output.width = o->layout_geometry.width;
+        output.height = o->layout_geometry.height;
+        output.refresh = o->wlr_output->refresh;
+        output.scale = o->wlr_output->scale;
+        output.transform = o->wlr_output->transform;
+        output.workspace = o->get_active()->num + 1;
+        output.adaptive = o->wlr_output->adaptive_sync_supported;
+        output.enabled = o->wlr_output->enabled;
+        output.focused = o == focused;
+
+        Workspace *w;
+        wl_list_for_each(w, &o->workspaces, link) {
+            if (workspace_count == IPC_STATE_MAX_WORKSPACES)
+                break;
+
+            IPCStateWorkspace &workspace = state->workspaces[workspace_count];
+            workspace.output = output_count;
+            workspace.number = w->num + 1;
+            workspace.focused = w == o->get_active();
+
+            Toplevel *t;
+            wl_list_for_each(t, &w->toplevels, link) {
+                if (toplevel_count == IPC_STATE_MAX_TOPLEVELS)
+                    break;
+
+                IPCStateToplevel &toplevel =
+                    state->toplevels[toplevel_count++];
+                toplevel.id = t->id;
+                toplevel.workspace = workspace_count;
+                toplevel.x = t->geometry.x;
+                toplevel.y = t->geometry.y;
+                toplevel.width = t->geometry.width;
+                toplevel.height = t->geometry.height;
+                toplevel.focused = t == w->active_toplevel;
+                toplevel.hidden = t->hidden;
+                toplevel.maximized = t->maximized();
+                toplevel.fullscreen = t->fullscreen();
+#ifdef XWAYLAND
+                toplevel.xwayland = !t->xdg_toplevel;
+#else
+                toplevel.xwayland = false;
+#endif
+                copy_string(toplevel.title, sizeof(toplevel.title),
+                            t->title().c_str());
+            }
+
+            ++workspace_count;
+        }
+
+        ++output_count;
+    }
+
+    state->output_count = output_count;
+    state->workspace_count = workspace_count;
+    state->toplevel_count = toplevel_count;
+
+    // even once written
+    state->sequence.store(sequence + 2, std::memory_order_release);
+
+    // wake readers
+    IPCClient *client;
+    wl_list_for_each(client, &clients, link) {
+        if (client->state_eventfd != -1)
+            eventfd_write(client->state_eventfd, 1);
+    }
+}
+
 void IPC::stop() {
-    // stop thread
-    running = false;
-    pthread_cancel(thread.native_handle());
-    if (thread.joinable())
-        thread.join();
+    // cancel pending events
+    if (idle_source)
+        wl_event_source_remove(idle_source);
+
+    // disconnect clients
+    IPCClient *client, *tmp;
+    wl_list_for_each_safe(client, tmp, &clients, link) delete client;
+
+    // stop the i3 listener
+    delete i3;
+
+    // stop accepting connections
+    if (event_source)
+        wl_event_source_remove(event_source);
 
     // close
     close(fd);
 
+    // unmap the state page, readers keep their own mappings
+    if (state) {
+        munmap(state, sizeof(IPCState));
+        close(state_fd);
+    }
+
     // unlink
     if (unlink(path.c_str()))
         wlr_log(WLR_ERROR, "failed to unlink IPC socket at path `%s`",
@@ -0,0 +1,284 @@
+#include "Server.h"
+
+// largest unframed command a client may send before it is dropped
+constexpr size_t IPC_MAX_COMMAND_SIZE = 64 * 1024;
+
+// bytes read from a client per event loop iteration
+constexpr size_t IPC_READ_CHUNK = 64 * 1024;
+
+// stop reading commands while this many reply bytes are queued
+constexpr size_t IPC_MAX_PENDING = 1024 * 1024;
+
+// drop a client which stopped reading once this many bytes are queued
+constexpr size_t IPC_MAX_QUEUED = 16 * 1024 * 1024;
+
+IPCClient::IPCClient(IPC *ipc, const int fd) : ipc(ipc), fd(fd) {
+    // watch the client socket on the compositor event loop
+    event_source = wl_event_loop_add_fd(
+        wl_display_get_event_loop(ipc->server->display), fd, WL_EVENT_READABLE,
+        []([[maybe_unused]] int fd, uint32_t mask, void *data) {
+            IPCClient *client = static_cast<IPCClient *>(data);
+
+            // client went away
+            if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) {
+                delete client;
+                return 0;
+            }
+
+            // send pending replies
+            if (mask & WL_EVENT_WRITABLE && !client->flush()) {
+                delete client;
+                return 0;
+            }
+
+            // read commands
+            if (mask & WL_EVENT_READABLE && !client->receive())
+                delete client;
+
+            return 0;
+        },
+        this);
+
+    wl_list_insert(&ipc->clients, &link);
+}
+
+// read what is available from the client and run complete commands,
+// returns false if the client should be dropped
+bool IPCClient::receive() {
+    char buffer[4096];
+    size_t total = 0;
+
+    while (total < IPC_READ_CHUNK) {
+        const ssize_t len = recv(fd, buffer, sizeof(buffer), 0);
+
+        if (len > 0) {
+            read_buffer.append(buffer, len);
+            total += len;
+        } else if (len == 0) {
+            // the client may still read replies after shutting down writing
+            done = true;
+            break;
+        } else if (errno == EINTR)
+            continue;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        else {
+            wlr_log(WLR_ERROR, "failed to read from IPC client with fd `%d`",
+                    fd);
+            return false;
+        }
+    }
+
+    return process() && flush();
+}
+
+// run every complete command in the read buffer, returns false if the
+// client sent invalid data
+bool IPCClient::process() {
+    // detect the protocol from the first read, framed clients write the
+    // whole header at once so anything not starting with the full magic is
+    // a legacy command
+    const bool first = protocol == IPC_CLIENT_PROTOCOL_UNKNOWN;
+    if (first) {
+        if (read_buffer.empty())
+            return true;
+
+        protocol = read_buffer.size() >= IPC_MAGIC_SIZE &&
+                           ipc_framed(read_buffer)
+                       ? IPC_CLIENT_PROTOCOL_FRAMED
+                       : IPC_CLIENT_PROTOCOL_LEGACY;
+    }
+
+    if (protocol == IPC_CLIENT_PROTOCOL_LEGACY) {
+        if (read_buffer.size() > IPC_MAX_COMMAND_SIZE) {
+            wlr_log(WLR_ERROR, "IPC client with fd `%d` sent too much data",
+                    fd);
+            return false;
+        }
+
+        // the first read is one whole command, legacy clients neither end
+        // it with a newline nor shut down writing, later commands of
+        // subscribers end at a newline or when the client shuts down writing
+        while (!read_buffer.empty()) {
+            std::string command;
+            if (const size_t end = read_buffer.find('\n');
+                end != std::string::npos) {
+                command = read_buffer.substr(0, end);
+                read_buffer.erase(0, end + 1);
+            } else if (first || done) {
+                command = std::move(read_buffer);
+                read_buffer.clear();
+            } else
+                // wait for the rest of the command
+                break;
+
+            send(IPC_MESSAGE_REPLY, ipc->run(command, this));
+
+            // subscribers keep the connection open
+            if (!subscriptions) {
+                done = true;
+                read_buffer.clear();
+            }
+        }
+
+        return true;
+    }
+
+    const std::string_view magic =
+        protocol == IPC_CLIENT_PROTOCOL_I3 ? I3_IPC_MAGIC : IPC_MAGIC;
+
+    // run commands in the order they were sent
+    uint32_t type;
+    std::string payload;
+    int status;
+    while ((status = ipc_parse(read_buffer, &type, &payload, magic)) == 1) {
+        if (protocol == IPC_CLIENT_PROTOCOL_I3)
+            // i3 replies have the type of their message
+            send(type, ipc->i3->run(type, payload, this));
+        else if (type == IPC_MESSAGE_COMMAND)
+            send(IPC_MESSAGE_REPLY, ipc->run(payload, this));
+        else {
+            // every message gets a reply so pipelined clients stay in step
+            wlr_log(WLR_ERROR,
+                    "IPC client with fd `%d` sent unexpected message type %u",
+                    fd, type);
+            send(IPC_MESSAGE_REPLY,
+                 R"({"success":false,"error":"unexpected message type"})");
+        }
+    }
+
+    if (status == -1) {
+        wlr_log(WLR_ERROR, "IPC client with fd `%d` sent a malformed message",
+                fd);
+        return false;
+    }
+
+    return true;
+}
+
+// write as much of the pending data as the socket accepts, returns false
+// once the client is done and all replies are sent, or the client errored
+bool IPCClient::flush() {
+    while (!write_buffer.empty()) {
+        // the state page fds travel with the first byte of their reply, so
+        // never send past the next reply carrying them
+        const bool attach = !state_offsets.empty() && !state_offsets.front();
+        size_t size = write_buffer.size();
+        for (const size_t offset : state_offsets)
+            if (offset) {
+                size = offset;
+                break;
+            }
+
+        const ssize_t len =
+            attach ? send_state(size)
+                   : ::send(fd, write_buffer.data(), size, MSG_NOSIGNAL);
+
+        if (len >= 0) {
+            write_buffer.erase(0, len);
+
+            if (attach)
+                state_offsets.pop_front();
+            for (size_t &offset : state_offsets)
+                offset -= len;
+        } else if (errno == EINTR)
+            continue;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            // wait until the client reads
+            break;
+        else {
+            wlr_log(WLR_ERROR, "failed to write to IPC client with fd `%d`",
+                    fd);
+            return false;
+        }
+    }
+
+    if (done && write_buffer.empty())
+        return false;
+
+    update_mask();
+    return true;
+}
+
+// send the start of the write buffer along with the state page memfd and
+// the client's eventfd
+ssize_t IPCClient::send_state(const size_t size) {
+    const int fds[2] = {ipc->state_fd, state_eventfd};
+
+    iovec iov{write_buffer.data(), size};
+    char control[CMSG_SPACE(sizeof(fds))]{};
+
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    return sendmsg(fd, &msg, MSG_NOSIGNAL);
+}
+
+// queue a message for the client
+void IPCClient::send(const uint32_t type, const std::string &payload) {
+    if (dropped)
+        return;
+
+    // a subscriber that stopped reading would grow the queue forever, drop
+    // it on the next flush
+    if (write_buffer.size() > IPC_MAX_QUEUED) {
+        wlr_log(WLR_ERROR, "IPC client with fd `%d` stopped reading", fd);
+        dropped = true;
+        done = true;
+        write_buffer.clear();
+        state_offsets.clear();
+        return;
+    }
+
+    if (attach_state) {
+        state_offsets.push_back(write_buffer.size());
+        attach_state = false;
+    }
+
+    if (protocol == IPC_CLIENT_PROTOCOL_FRAMED)
+        write_buffer += ipc_frame(type, payload);
+    else if (protocol == IPC_CLIENT_PROTOCOL_I3)
+        write_buffer += ipc_frame(type, payload, I3_IPC_MAGIC);
+    else {
+        write_buffer += payload;
+
+        // subscribers read a stream of newline separated messages
+        if (subscriptions)
+            write_buffer += '\n';
+    }
+}
+
+// update the events the client socket is polled for
+void IPCClient::update_mask() {
+    uint32_t mask = 0;
+
+    if (!write_buffer.empty())
+        mask |= WL_EVENT_WRITABLE;
+
+    if (!done && write_buffer.size() < IPC_MAX_PENDING)
+        mask |= WL_EVENT_READABLE;
+
+    if (this->mask == mask)
+        return;
+
+    this->mask = mask;
+    wl_event_source_fd_update(event_source, mask);
+}
+
+IPCClient::~IPCClient() {
+    wl_event_source_remove(event_source);
+    close(fd);
+
+    if (state_eventfd != -1)
+        close(state_eventfd);
+    wl_list_remove(&link);
+}
@@ -0,0 +1,35 @@
+#include "InputStats.h"
+#include <algorithm>
+#include <ctime>
+
+// drop all recorded latencies
+void InputStats::reset() {
+    key.reset();
+    motion.reset();
+    button.reset();
+}
+
+// get the CLOCK_MONOTONIC time in microseconds
+uint64_t InputStats::now() {
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+// get the time since an event timestamp on CLOCK_MONOTONIC, event
+// timestamps only have millisecond precision so this is up to 1 ms late
+uint64_t InputStats::latency(const uint32_t time_msec) {
+    const uint64_t usec = now();
+
+    // millisecond timestamps wrap around, unsigned subtraction handles that
+    const uint32_t elapsed = static_cast<uint32_t>(usec / 1000) - time_msec;
+
+    return static_cast<uint64_t>(elapsed) * 1000 + usec % 1000;
+}
+
+// get the CLOCK_MONOTONIC time of an event in microseconds
+uint64_t InputStats::event_time(const uint32_t time_msec) {
+    const uint64_t usec = now();
+    return usec - std::min(usec, latency(time_msec));
+}
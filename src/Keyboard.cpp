@@ -1,8 +1,16 @@
 #include "Server.h"
 
+// key of a bind in the keyboard's bind table
+static uint64_t keycode_key(const xkb_layout_index_t layout,
+                            const xkb_keycode_t keycode,
+                            const uint32_t modifiers) {
+    return static_cast<uint64_t>(layout) << 40 |
+           static_cast<uint64_t>(keycode) << 8 | (modifiers & 0xff);
+}
+
 // execute either a wm bind or command bind, returns true if
 // bind is valid, false otherwise
-bool Keyboard::handle_bind(const Bind bind) {
+bool Keyboard::handle_bind(const CompiledBind bind) {
     // retrieve config
     Config *config = server->config;
 
@@ -11,19 +19,16 @@ bool Keyboard::handle_bind(const Bind bind) {
     if (!output)
         return false;
 
-    // handle user-defined binds
-    for (const auto &[cmd_bind, cmd] : config->commands)
-        if (cmd_bind == bind)
-            if (fork() == 0) {
-                execl("/bin/sh", "/bin/sh", "-c", cmd.c_str(), nullptr);
-                return true;
-            }
-
-    // handle compositor binds
-    if (bind == config->exit) {
+    switch (bind.action) {
+    case BIND_COMMAND:
+        // run user-defined command
+        spawn(config->commands[bind.argument].second);
+        break;
+    case BIND_EXIT:
         // exit compositor
         server->exit();
-    } else if (bind == config->window_fullscreen) {
+        break;
+    case BIND_WINDOW_FULLSCREEN: {
         // fullscreen the active toplevel
         Toplevel *active = output->get_active()->active_toplevel;
 
@@ -31,95 +36,123 @@ bool Keyboard::handle_bind(const Bind bind) {
             return false;
 
         active->toggle_fullscreen();
-    } else if (bind == config->window_previous) {
+        break;
+    }
+    case BIND_WINDOW_PREVIOUS:
         // focus the previous toplevel in the active workspace
         output->get_active()->focus_prev();
-    } else if (bind == config->window_next) {
+        break;
+    case BIND_WINDOW_NEXT:
         // focus the next toplevel in the active workspace
         output->get_active()->focus_next();
-    } else if (bind == config->window_move) {
+        break;
+    case BIND_WINDOW_MOVE:
         // move the active toplevel with the mouse
         if (Toplevel *active = output->get_active()->active_toplevel)
             active->begin_interactive(CURSORMODE_MOVE, 0);
-    } else if (bind == config->window_up) {
-        // focus the toplevel in the up direction
-        if (Toplevel *up = output->get_active()->in_direction(WLR_DIRECTION_UP))
-            output->get_active()->focus_toplevel(up);
-    } else if (bind == config->window_down) {
-        // focus the toplevel in the down direction
-        if (Toplevel *down =
-                output->get_active()->in_direction(WLR_DIRECTION_DOWN))
-            output->get_active()->focus_toplevel(down);
-    } else if (bind == config->window_left) {
-        // focus the toplevel in the left direction
-        if (Toplevel *left =
-                output->get_active()->in_direction(WLR_DIRECTION_LEFT))
-            output->get_active()->focus_toplevel(left);
-    } else if (bind == config->window_right) {
-        // focus the toplevel in the right direction
-        Toplevel *right =
-            output->get_active()->in_direction(WLR_DIRECTION_RIGHT);
-        if (right)
-            output->get_active()->focus_toplevel(right);
-    } else if (bind == config->window_close) {
+        break;
+    case BIND_WINDOW_UP:
+    case BIND_WINDOW_DOWN:
+    case BIND_WINDOW_LEFT:
+    case BIND_WINDOW_RIGHT: {
+        // focus the toplevel in the direction
+        const wlr_direction directions[] = {
+            WLR_DIRECTION_UP, WLR_DIRECTION_DOWN, WLR_DIRECTION_LEFT,
+            WLR_DIRECTION_RIGHT};
+        if (Toplevel *other = output->get_active()->in_direction(
+                directions[bind.action - BIND_WINDOW_UP]))
+            output->get_active()->focus_toplevel(other);
+        break;
+    }
+    case BIND_WINDOW_CLOSE:
         // close the active toplevel
         output->get_active()->close_active();
-    } else if (bind == config->window_swap_up) {
-        // swap the active toplevel with the one above it
-        if (Toplevel *other =
-                output->get_active()->in_direction(WLR_DIRECTION_UP))
-            output->get_active()->swap(other);
-    } else if (bind == config->window_swap_down) {
-        // swap the active toplevel with the one below it
-        Toplevel *other =
-            output->get_active()->in_direction(WLR_DIRECTION_DOWN);
-        if (other)
-            output->get_active()->swap(other);
-    } else if (bind == config->window_swap_left) {
-        // swap the active toplevel with the one to the left of it
-        Toplevel *other =
-            output->get_active()->in_direction(WLR_DIRECTION_LEFT);
-        if (other)
+        break;
+    case BIND_WINDOW_SWAP_UP:
+    case BIND_WINDOW_SWAP_DOWN:
+    case BIND_WINDOW_SWAP_LEFT:
+    case BIND_WINDOW_SWAP_RIGHT: {
+        // swap the active toplevel with the one in the direction
+        const wlr_direction directions[] = {
+            WLR_DIRECTION_UP, WLR_DIRECTION_DOWN, WLR_DIRECTION_LEFT,
+            WLR_DIRECTION_RIGHT};
+        if (Toplevel *other = output->get_active()->in_direction(
+                directions[bind.action - BIND_WINDOW_SWAP_UP]))
             output->get_active()->swap(other);
-    } else if (bind == config->window_swap_right) {
-        // swap the active toplevel with the one to the right of it
-        Toplevel *other =
-            output->get_active()->in_direction(WLR_DIRECTION_RIGHT);
-        if (other)
-            output->get_active()->swap(other);
-    } else if (bind == config->workspace_tile) {
+        break;
+    }
+    case BIND_WORKSPACE_TILE:
         // set workspace to tile
         output->get_active()->tile();
-    } else if (bind.sym >= XKB_KEY_0 && bind.sym <= XKB_KEY_9) {
-        // digit pressed
-        const Bind digit_bind = Bind{bind.modifiers, XKB_KEY_NoSymbol};
-
-        // 0 is on the right of 9 so it makes more sense this way
-        const int n = XKB_KEY_0 == bind.sym ? 10 : bind.sym - XKB_KEY_0 - 1;
-
-        if (digit_bind == config->workspace_open) {
-            // set workspace to n
-            return output->set_workspace(n);
-        } else if (digit_bind == config->workspace_window_to) {
-            // move active toplevel to workspace n
-            Workspace *current = output->get_active();
-            Workspace *target = output->get_workspace(n);
-
-            if (target == nullptr)
-                return false;
-
-            if (current->active_toplevel)
-                current->move_to(current->active_toplevel, target);
-        } else
+        break;
+    case BIND_WORKSPACE_OPEN:
+        // set workspace to n
+        return output->set_workspace(bind.argument);
+    case BIND_WORKSPACE_WINDOW_TO: {
+        // move active toplevel to workspace n
+        Workspace *current = output->get_active();
+        Workspace *target = output->get_workspace(bind.argument);
+
+        if (target == nullptr)
             return false;
-    } else
-        return false;
+
+        if (current->active_toplevel)
+            current->move_to(current->active_toplevel, target);
+        break;
+    }
+    }
 
     return true;
 }
 
+// resolve the config's bind table to the keycodes of this keymap, a key
+// press then costs one lookup
+void Keyboard::compile_binds() {
+    binds.clear();
+
+    xkb_keymap *keymap = wlr_keyboard->keymap;
+    if (!keymap)
+        return;
+
+    // keycodes producing each keysym without modifiers, in every layout
+    using Key = std::pair<xkb_layout_index_t, xkb_keycode_t>;
+    std::unordered_map<xkb_keysym_t, std::vector<Key>> keys;
+
+    const xkb_keycode_t max = xkb_keymap_max_keycode(keymap);
+    for (xkb_keycode_t keycode = xkb_keymap_min_keycode(keymap);
+         keycode <= max; ++keycode) {
+        const xkb_layout_index_t layouts =
+            xkb_keymap_num_layouts_for_key(keymap, keycode);
+
+        for (xkb_layout_index_t layout = 0; layout != layouts; ++layout) {
+            const xkb_keysym_t *syms;
+            const int nsyms = xkb_keymap_key_get_syms_by_level(
+                keymap, keycode, layout, 0, &syms);
+
+            for (int i = 0; i != nsyms; ++i)
+                keys[syms[i]].emplace_back(layout, keycode);
+        }
+    }
+
+    // add every bind for each keycode of its keysym
+    for (const auto &[key, bind] : server->config->bind_table) {
+        const auto found = keys.find(static_cast<xkb_keysym_t>(key));
+        if (found == keys.end())
+            continue;
+
+        for (const auto &[layout, keycode] : found->second)
+            binds.emplace(keycode_key(layout, keycode, key >> 32), bind);
+    }
+}
+
 // update the keyboard config
-void Keyboard::update_config() const {
+void Keyboard::update_config() {
+    update_keymap();
+    update_repeat();
+}
+
+// compile and set the keymap from the config
+void Keyboard::update_keymap() {
     // create xkb context
     xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
 
@@ -153,21 +186,14 @@ void Keyboard::update_config() const {
     xkb_keymap_unref(keymap);
     xkb_context_unref(context);
 
-    // repeat info
-    wlr_keyboard_set_repeat_info(wlr_keyboard, server->config->repeat_rate,
-                                 server->config->repeat_delay);
+    // keycodes of binds depend on the keymap
+    compile_binds();
 }
 
-// get keysyms without modifiers applied
-uint32_t Keyboard::keysyms_raw(const xkb_keycode_t keycode,
-                               const xkb_keysym_t **keysyms,
-                               uint32_t *modifiers) const {
-    *modifiers = wlr_keyboard_get_modifiers(wlr_keyboard);
-
-    const xkb_layout_index_t layout_index =
-        xkb_state_key_get_layout(wlr_keyboard->xkb_state, keycode);
-    return xkb_keymap_key_get_syms_by_level(wlr_keyboard->keymap, keycode,
-                                            layout_index, 0, keysyms);
+// set repeat info from the config
+void Keyboard::update_repeat() const {
+    wlr_keyboard_set_repeat_info(wlr_keyboard, server->config->repeat_rate,
+                                 server->config->repeat_delay);
 }
 
 // get keysyms with modifiers applied
@@ -184,7 +210,8 @@ uint32_t Keyboard::keysyms_translated(const xkb_keycode_t keycode,
 }
 
 Keyboard::Keyboard(Server *server, wlr_input_device *device)
-    : server(server), wlr_keyboard(wlr_keyboard_from_input_device(device)) {
+    : server(server), wlr_keyboard(wlr_keyboard_from_input_device(device)),
+      stats(server->get_input_stats(device)) {
     // set data
     wlr_keyboard->data = this;
 
@@ -220,25 +247,35 @@ Keyboard::Keyboard(Server *server, wlr_input_device *device)
 
         if (!server->locked && event->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
             // modifiers
-            uint32_t modifiers = 0;
-
-            // raw
-            const xkb_keysym_t *syms_raw;
-            uint32_t nsyms_raw =
-                keyboard->keysyms_raw(keycode, &syms_raw, &modifiers);
-
-            for (uint32_t i = 0; i != nsyms_raw; ++i)
-                handled = keyboard->handle_bind(Bind{modifiers, syms_raw[i]});
-
-            // translated
-            const xkb_keysym_t *syms_translated;
-            uint32_t nsyms_translated = keyboard->keysyms_translated(
-                keycode, &syms_translated, &modifiers);
-
-            if (modifiers & WLR_MODIFIER_SHIFT || modifiers & WLR_MODIFIER_CAPS)
-                for (uint32_t i = 0; i != nsyms_translated; ++i)
-                    handled = keyboard->handle_bind(
-                        Bind{modifiers, syms_translated[i]});
+            uint32_t modifiers =
+                wlr_keyboard_get_modifiers(keyboard->wlr_keyboard);
+
+            // raw keysyms, looked up by keycode
+            const xkb_layout_index_t layout = xkb_state_key_get_layout(
+                keyboard->wlr_keyboard->xkb_state, keycode);
+            const auto bind =
+                keyboard->binds.find(keycode_key(layout, keycode, modifiers));
+
+            if (bind != keyboard->binds.end())
+                handled = keyboard->handle_bind(bind->second);
+            else if (modifiers & (WLR_MODIFIER_SHIFT | WLR_MODIFIER_CAPS)) {
+                // translated keysyms, looked up by keysym
+                const Config *config = server->config;
+                const xkb_keysym_t *syms_translated;
+                const uint32_t nsyms_translated = keyboard->keysyms_translated(
+                    keycode, &syms_translated, &modifiers);
+
+                if (modifiers & WLR_MODIFIER_SHIFT ||
+                    modifiers & WLR_MODIFIER_CAPS)
+                    for (uint32_t i = 0; i != nsyms_translated; ++i) {
+                        const auto translated = config->bind_table.find(
+                            bind_key(modifiers, syms_translated[i]));
+
+                        if (translated != config->bind_table.end())
+                            handled |=
+                                keyboard->handle_bind(translated->second);
+                    }
+            }
         }
 
         if (!handled) {
@@ -246,6 +283,9 @@ Keyboard::Keyboard(Server *server, wlr_input_device *device)
             wlr_seat_set_keyboard(seat, keyboard->wlr_keyboard);
             wlr_seat_keyboard_notify_key(seat, event->time_msec, event->keycode,
                                          event->state);
+            keyboard->stats->key.add(InputStats::latency(event->time_msec));
+            server->note_input(seat->keyboard_state.focused_surface,
+                               event->time_msec);
         }
     };
     wl_signal_add(&wlr_keyboard->events.key, &key);
@@ -108,6 +108,8 @@ LayerSurface::LayerSurface(Output *output,
 }
 
 LayerSurface::~LayerSurface() {
+    output->server->invalidate_hit_index();
+
     // remove links
     wl_list_remove(&link);
     wl_list_remove(&map.link);
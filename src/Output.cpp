@@ -1,8 +1,16 @@
 #include "Server.h"
 #include <stdexcept>
+#include <sys/timerfd.h>
+
+// committed frames kept waiting for a present event
+constexpr size_t OUTPUT_MAX_PENDING_FRAMES = 16;
+
+// time left between the end of rendering and the vblank with
+// RENDER_DELAY_AUTO, in ns
+constexpr uint64_t OUTPUT_RENDER_MARGIN = 2000000;
 
 Output::Output(Server *server, struct wlr_output *wlr_output)
-    : server(server), wlr_output(wlr_output) {
+    : server(server), id(server->next_id++), wlr_output(wlr_output) {
 
     wl_list_init(&workspaces);
 
@@ -25,27 +33,76 @@ Output::Output(Server *server, struct wlr_output *wlr_output)
     update_position();
     usable_area = layout_geometry;
 
+    // render timer
+    render_timer_fd =
+        timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (render_timer_fd == -1)
+        wlr_log(WLR_ERROR, "failed to create render timer: %s",
+                strerror(errno));
+    else
+        render_timer = wl_event_loop_add_fd(
+            wl_display_get_event_loop(server->display), render_timer_fd,
+            WL_EVENT_READABLE,
+            [](int fd, uint32_t, void *data) {
+                uint64_t expirations;
+                if (read(fd, &expirations, sizeof(expirations)) > 0)
+                    static_cast<Output *>(data)->render();
+                return 0;
+            },
+            this);
+
     // frame
     frame.notify = [](wl_listener *listener, [[maybe_unused]] void *data) {
         // called once per frame
         Output *output = wl_container_of(listener, output, frame);
-        wlr_scene *scene = output->server->scene;
 
-        wlr_scene_output *scene_output =
-            wlr_scene_get_scene_output(scene, output->wlr_output);
+        // already waiting to render
+        if (output->render_pending)
+            return;
 
-        // render scene
-        wlr_scene_output_commit(scene_output, nullptr);
+        // render now or later
+        const uint64_t delay = output->next_render_delay();
+        output->last_render_delay = delay;
+        if (!delay) {
+            output->render();
+            return;
+        }
 
-        // get frame time
-        timespec now{};
-        clock_gettime(CLOCK_MONOTONIC, &now);
-        wlr_scene_output_send_frame_done(scene_output, &now);
+        itimerspec timer{};
+        timer.it_value.tv_sec = delay / 1000000000;
+        timer.it_value.tv_nsec = delay % 1000000000;
+        if (timerfd_settime(output->render_timer_fd, 0, &timer, nullptr) ==
+            -1) {
+            output->render();
+            return;
+        }
 
-        // output->arrange_layers();
+        output->render_pending = true;
     };
     wl_signal_add(&wlr_output->events.frame, &frame);
 
+    // present
+    present.notify = [](wl_listener *listener, void *data) {
+        Output *output = wl_container_of(listener, output, present);
+        const auto *event = static_cast<wlr_output_event_present *>(data);
+
+        // predict the next vblank from the last one
+        if (event->presented) {
+            output->last_present =
+                static_cast<uint64_t>(event->when.tv_sec) * 1000000000 +
+                event->when.tv_nsec;
+
+            if (event->refresh > 0)
+                output->refresh_period = event->refresh;
+            else if (output->wlr_output->refresh > 0)
+                output->refresh_period =
+                    1000000000000 / output->wlr_output->refresh;
+        }
+
+        output->present_inputs(event);
+    };
+    wl_signal_add(&wlr_output->events.present, &present);
+
     // request_state
     request_state.notify = [](wl_listener *listener, void *data) {
         Output *output = wl_container_of(listener, output, request_state);
@@ -63,16 +120,401 @@ Output::Output(Server *server, struct wlr_output *wlr_output)
         delete output;
     };
     wl_signal_add(&wlr_output->events.destroy, &destroy);
+
+    // scanout sample, only added for the duration of a commit
+    scanout_sample.notify = [](wl_listener *listener, void *data) {
+        Output *output = wl_container_of(listener, output, scanout_sample);
+        const auto *event = static_cast<wlr_scene_output_sample_event *>(data);
+
+        if (event->output == output->scene_output && event->direct_scanout)
+            output->scanned_out = true;
+    };
 }
 
 Output::~Output() {
     Workspace *workspace, *tmp;
     wl_list_for_each_safe(workspace, tmp, &workspaces, link) delete workspace;
 
+    if (render_timer)
+        wl_event_source_remove(render_timer);
+    if (render_timer_fd != -1)
+        close(render_timer_fd);
+
     wl_list_remove(&frame.link);
+    wl_list_remove(&present.link);
     wl_list_remove(&request_state.link);
     wl_list_remove(&destroy.link);
     wl_list_remove(&link);
+
+    // cached listings may refer to this output
+    if (server->ipc)
+        server->ipc->invalidate(IPC_SNAPSHOT_ALL);
+}
+
+// predict the first vblank after now in ns, 0 if it can not be predicted
+// without presentation feedback or with adaptive sync
+uint64_t Output::next_vblank(const uint64_t now) const {
+    if (!last_present || !refresh_period ||
+        wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED)
+        return 0;
+
+    uint64_t vblank = last_present + refresh_period;
+    if (vblank <= now)
+        vblank += ((now - vblank) / refresh_period + 1) * refresh_period;
+
+    return vblank;
+}
+
+// get how long to wait after a frame event before rendering in ns, 0 to
+// render right away
+uint64_t Output::next_render_delay() const {
+    if (!render_delay || render_timer_fd == -1)
+        return 0;
+
+    // fixed delay
+    if (render_delay != RENDER_DELAY_AUTO)
+        return static_cast<uint64_t>(render_delay) * 1000000;
+
+    timespec time{};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    const uint64_t now =
+        static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+
+    const uint64_t vblank = next_vblank(now);
+    if (!vblank)
+        return 0;
+
+    // finish the slowest recent render a margin before the vblank
+    const uint64_t budget =
+        *std::max_element(render_times.begin(), render_times.end()) +
+        OUTPUT_RENDER_MARGIN;
+
+    return vblank > now + budget ? vblank - now - budget : 0;
+}
+
+// returns true if the focused toplevel is fullscreen on this output and asks
+// for async presentation
+bool Output::wants_tearing() const {
+    if (!allow_tearing)
+        return false;
+
+    const Toplevel *toplevel = get_active()->active_toplevel;
+    if (!toplevel || toplevel->hidden || !toplevel->fullscreen())
+        return false;
+
+    // only while it has keyboard focus
+    wlr_surface *surface = toplevel->surface();
+    if (!surface || surface != server->seat->keyboard_state.focused_surface)
+        return false;
+
+    return wlr_tearing_control_manager_v1_surface_hint_from_surface(
+               server->wlr_tearing_control_manager, surface) ==
+           WP_TEARING_CONTROL_V1_PRESENTATION_HINT_ASYNC;
+}
+
+// commit the scene, with an async page flip if the focused toplevel wants one
+// and the backend takes it
+bool Output::commit() {
+    if (!wants_tearing()) {
+        tearing_tested = false;
+        return wlr_scene_output_commit(scene_output, nullptr);
+    }
+
+    wlr_output_state state;
+    wlr_output_state_init(&state);
+    if (!wlr_scene_output_build_state(scene_output, &state, nullptr)) {
+        wlr_output_state_finish(&state);
+        return false;
+    }
+
+    // test async page flips once tearing starts and again when the buffer
+    // format changes, rather than every frame
+    uint32_t format = 0;
+    wlr_dmabuf_attributes attribs;
+    if (state.buffer && wlr_buffer_get_dmabuf(state.buffer, &attribs))
+        format = attribs.format;
+
+    if (!tearing_tested || (format && format != tearing_format)) {
+        state.tearing_page_flip = true;
+        tearing_supported = wlr_output_test_state(wlr_output, &state);
+        tearing_tested = true;
+        tearing_format = format;
+    }
+
+    state.tearing_page_flip = tearing_supported;
+    bool committed = wlr_output_commit_state(wlr_output, &state);
+
+    // fall back to vsync if the backend rejects the async page flip anyway
+    if (!committed && state.tearing_page_flip) {
+        tearing_supported = false;
+        state.tearing_page_flip = false;
+        committed = wlr_output_commit_state(wlr_output, &state);
+    }
+
+    if (committed && state.tearing_page_flip)
+        ++frames_torn;
+
+    wlr_output_state_finish(&state);
+    return committed;
+}
+
+// buffers shown on an output
+struct OutputBuffers {
+    const wlr_scene_output *output;
+    std::vector<wlr_scene_buffer *> buffers;
+};
+
+static void add_output_buffer(wlr_scene_buffer *buffer, int, int,
+                              void *data) {
+    auto *output_buffers = static_cast<OutputBuffers *>(data);
+    if (buffer->primary_output == output_buffers->output)
+        output_buffers->buffers.push_back(buffer);
+}
+
+// find the buffer of a fullscreen toplevel which could be scanned out
+// directly, or set reason to why it can not be
+wlr_scene_buffer *Output::scanout_candidate(OutputScanout *reason) const {
+    *reason = OUTPUTSCANOUT_NONE;
+
+    // fullscreen toplevel on the active workspace
+    const Toplevel *fullscreen = nullptr;
+    Toplevel *toplevel;
+    wl_list_for_each(toplevel, &get_active()->toplevels, link)
+        if (!toplevel->hidden && toplevel->scene_tree &&
+            toplevel->fullscreen()) {
+            fullscreen = toplevel;
+            break;
+        }
+
+    if (!fullscreen)
+        return nullptr;
+
+    // a single buffer on the output, nothing from subsurfaces, popups or the
+    // layers above, the top layer sits below the fullscreen one so bars and
+    // docks there are covered and do not prevent scanout
+    OutputBuffers shown{scene_output, {}};
+    wlr_scene_node_for_each_buffer(&fullscreen->scene_tree->node,
+                                   add_output_buffer, &shown);
+    const size_t own = shown.buffers.size();
+
+    for (wlr_scene_tree *tree : {server->layers.overlay,
+                                 server->layers.drag_icon, server->layers.lock})
+        wlr_scene_node_for_each_buffer(&tree->node, add_output_buffer,
+                                       &shown);
+
+    if (own != 1 || shown.buffers.size() != 1) {
+        *reason = OUTPUTSCANOUT_OCCLUSION;
+        return nullptr;
+    }
+
+    wlr_scene_buffer *buffer = shown.buffers.front();
+    if (!buffer->buffer) {
+        *reason = OUTPUTSCANOUT_OCCLUSION;
+        return nullptr;
+    }
+
+    // the buffer has to be shown as is
+    if (buffer->transform != wlr_output->transform) {
+        *reason = OUTPUTSCANOUT_TRANSFORM;
+        return nullptr;
+    }
+
+    const wlr_fbox &src = buffer->src_box;
+    if (buffer->buffer->width != wlr_output->width ||
+        buffer->buffer->height != wlr_output->height ||
+        (!wlr_fbox_empty(&src) &&
+         (src.x != 0 || src.y != 0 || src.width != buffer->buffer->width ||
+          src.height != buffer->buffer->height))) {
+        *reason = OUTPUTSCANOUT_SCALE;
+        return nullptr;
+    }
+
+    // software cursors are composited
+    wlr_output_cursor *cursor;
+    wl_list_for_each(cursor, &wlr_output->cursors, link)
+        if (cursor->enabled && cursor->visible &&
+            cursor != wlr_output->hardware_cursor) {
+            *reason = OUTPUTSCANOUT_CURSOR;
+            return nullptr;
+        }
+
+    return buffer;
+}
+
+// render and commit the scene if it changed, then send frame done
+void Output::render() {
+    render_pending = false;
+    if (!scene_output)
+        return;
+
+    // hit-test coalesced pointer motion before rendering
+    server->cursor->flush_motion();
+
+    // render scene only if something changed, the scene schedules the next
+    // frame on damage so an idle output gets no more frame events
+    if (!wlr_scene_output_needs_frame(scene_output))
+        ++frames_skipped;
+    else {
+        timespec start{}, end{};
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        // watch the buffer the scene may scan out
+        OutputScanout reason;
+        wlr_scene_buffer *candidate = scanout_candidate(&reason);
+        scanned_out = false;
+        if (candidate)
+            wl_signal_add(&candidate->events.output_sample, &scanout_sample);
+
+        const uint32_t commit_seq = wlr_output->commit_seq;
+        const bool committed = commit();
+
+        // the backend rejected an otherwise suitable buffer, likely for its
+        // format or modifier
+        if (candidate) {
+            wl_list_remove(&scanout_sample.link);
+            reason = scanned_out ? OUTPUTSCANOUT_DIRECT : OUTPUTSCANOUT_FORMAT;
+        }
+
+        if (!committed)
+            ++frames_failed;
+        else if (wlr_output->commit_seq != commit_seq) {
+            ++frames_committed;
+
+            scanout = reason;
+            ++scanout_frames[reason];
+
+            // inputs committed by clients are shown by the new frame
+            collect_inputs();
+        } else
+            ++frames_skipped;
+
+        // remember how long it took
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        render_times[render_time_index++ % render_times.size()] =
+            (end.tv_sec - start.tv_sec) * 1000000000 + end.tv_nsec -
+            start.tv_nsec;
+    }
+
+    // frame callbacks are due either way, the scene schedules a frame for
+    // them without damage
+    send_frame_done();
+}
+
+// send frame done to the buffers shown on an output, except the subtrees in
+// skip
+static void send_frame_done(wlr_scene_node *node, wlr_scene_output *output,
+                            const std::vector<wlr_scene_node *> &skip,
+                            const timespec *now) {
+    if (!node->enabled ||
+        std::find(skip.begin(), skip.end(), node) != skip.end())
+        return;
+
+    if (node->type == WLR_SCENE_NODE_BUFFER) {
+        wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
+        if (buffer->primary_output == output)
+            wlr_scene_buffer_send_frame_done(buffer, now);
+    } else if (node->type == WLR_SCENE_NODE_TREE) {
+        const wlr_scene_tree *tree = wlr_scene_tree_from_node(node);
+
+        wlr_scene_node *child;
+        wl_list_for_each(child, &tree->children, link)
+            send_frame_done(child, output, skip, now);
+    }
+}
+
+// send frame done after a frame, toplevels of the active workspace get it
+// later with frame_delay
+void Output::send_frame_done() {
+    timespec time{};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    const uint64_t now =
+        static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+
+    // clients have to commit before the next render starts
+    const uint64_t vblank = frame_delay ? next_vblank(now) : 0;
+    if (!vblank) {
+        wlr_scene_output_send_frame_done(scene_output, &time);
+        return;
+    }
+
+    const uint64_t deadline = vblank + last_render_delay;
+
+    std::vector<wlr_scene_node *> delayed;
+    Toplevel *toplevel;
+    wl_list_for_each(toplevel, &get_active()->toplevels, link) {
+        if (toplevel->hidden || !toplevel->scene_tree)
+            continue;
+
+        toplevel->schedule_frame_done(deadline, now);
+        delayed.push_back(&toplevel->scene_tree->node);
+    }
+
+    ::send_frame_done(&server->scene->tree.node, scene_output, delayed,
+                      &time);
+}
+
+// attach the committed inputs of the toplevels on this output to the frame
+// just committed
+void Output::collect_inputs() {
+    std::vector<Toplevel *> &committed = server->committed_inputs;
+    std::vector<std::pair<uint64_t, std::string>> inputs;
+
+    for (auto it = committed.begin(); it != committed.end();) {
+        Toplevel *toplevel = *it;
+
+        // left for the frame of another output
+        if (toplevel->output && toplevel->output != this) {
+            ++it;
+            continue;
+        }
+
+        // toplevels that are not shown are dropped
+        if (toplevel->output && !toplevel->hidden)
+            inputs.emplace_back(toplevel->committed_input_time,
+                                toplevel->app_id());
+
+        toplevel->committed_input_time = 0;
+        it = committed.erase(it);
+    }
+
+    if (inputs.empty())
+        return;
+
+    // without present events the oldest frames are given up on
+    if (pending_frames.size() == OUTPUT_MAX_PENDING_FRAMES)
+        pending_frames.erase(pending_frames.begin());
+
+    pending_frames.push_back({wlr_output->commit_seq, std::move(inputs)});
+}
+
+// record the input to present latency of the frames up to a presented
+// commit, inputs of discarded frames are dropped
+void Output::present_inputs(const wlr_output_event_present *event) {
+    if (pending_frames.empty())
+        return;
+
+    // presentation time, or now if the backend does not know it
+    uint64_t when = static_cast<uint64_t>(event->when.tv_sec) * 1000000 +
+                    event->when.tv_nsec / 1000;
+    if (!when)
+        when = InputStats::now();
+
+    // commit sequences wrap around
+    auto it = pending_frames.begin();
+    for (; it != pending_frames.end() &&
+           static_cast<int32_t>(event->commit_seq - it->commit_seq) >= 0;
+         ++it) {
+        if (!event->presented)
+            continue;
+
+        for (const auto &[time, app_id] : it->inputs) {
+            const uint64_t latency = when - std::min(when, time);
+            present_latency.add(latency);
+            server->present_latency[app_id].add(latency);
+        }
+    }
+
+    pending_frames.erase(pending_frames.begin(), it);
 }
 
 // arrange all layers
@@ -97,6 +539,9 @@ void Output::arrange_layers() {
     if (memcmp(&usable, &usable_area, sizeof(wlr_box)) != 0)
         usable_area = usable;
 
+    // layer surfaces may have moved
+    server->invalidate_hit_index();
+
     // handle keyboard interactive layers
     LayerSurface *topmost = nullptr;
     wlr_scene_tree *layers_above_shell[] = {layers.overlay, layers.top};
@@ -204,6 +649,10 @@ bool Output::set_workspace(const uint32_t n) {
     requested->set_hidden(false);
     requested->focus();
 
+    // notify subscribers
+    if (IPC *ipc = server->ipc)
+        ipc->notify(IPC_EVENT_WORKSPACE | IPC_EVENT_FOCUS);
+
     return true;
 }
 
@@ -211,6 +660,10 @@ bool Output::set_workspace(const uint32_t n) {
 void Output::update_position() {
     wlr_output_layout_get_box(server->output_manager->layout, wlr_output,
                               &layout_geometry);
+    server->invalidate_hit_index();
+
+    if (server->ipc)
+        server->ipc->invalidate(IPC_SNAPSHOT_OUTPUTS);
 }
 
 // apply a config to the output
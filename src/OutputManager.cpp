@@ -59,6 +59,11 @@ OutputManager::OutputManager(Server *server) : server(server) {
 
         // apply the config
         bool config_success = matching && output->apply_config(matching, false);
+        if (matching) {
+            output->render_delay = matching->render_delay;
+            output->frame_delay = matching->frame_delay;
+            output->allow_tearing = matching->allow_tearing;
+        }
 
         // fallback
         if (!config_success) {
@@ -87,10 +92,10 @@ OutputManager::OutputManager(Server *server) : server(server) {
                 : wlr_output_layout_add_auto(manager->layout, wlr_output);
 
         // add to scene output
-        wlr_scene_output *scene_output =
+        output->scene_output =
             wlr_scene_output_create(server->scene, wlr_output);
-        wlr_scene_output_layout_add_output(server->scene_layout,
-                                           output_layout_output, scene_output);
+        wlr_scene_output_layout_add_output(
+            server->scene_layout, output_layout_output, output->scene_output);
 
         // set usable area
         wlr_output_layout_get_box(manager->layout, wlr_output,
@@ -168,6 +173,10 @@ void OutputManager::apply_config(wlr_output_configuration_v1 *cfg,
         wlr_output_configuration_v1_send_failed(cfg);
 
     arrange();
+
+    // notify subscribers
+    if (!test_only && server->ipc)
+        server->ipc->notify(IPC_EVENT_OUTPUT);
 }
 
 // get output by wlr_output
@@ -1,7 +1,14 @@
 #include "Server.h"
 
-PointerConstraint::PointerConstraint(wlr_pointer_constraint_v1 *constraint)
-    : constraint(constraint) {
+PointerConstraint::PointerConstraint(Server *server,
+                                     wlr_pointer_constraint_v1 *constraint)
+    : server(server), constraint(constraint) {
+    // add to registry
+    server->pointer_constraints[constraint->surface] = this;
+
+    // activate right away if the surface already has pointer focus
+    if (constraint->surface == server->seat->pointer_state.focused_surface)
+        server->cursor->constrain(this);
 
     // destroy
     destroy.notify = [](struct wl_listener *listener,
@@ -13,4 +20,14 @@ PointerConstraint::PointerConstraint(wlr_pointer_constraint_v1 *constraint)
     wl_signal_add(&constraint->events.destroy, &destroy);
 }
 
-PointerConstraint::~PointerConstraint() { wl_list_remove(&destroy.link); }
+PointerConstraint::~PointerConstraint() {
+    wl_list_remove(&destroy.link);
+
+    // remove from registry
+    server->pointer_constraints.erase(constraint->surface);
+
+    if (server->cursor->active_constraint == this) {
+        server->cursor->active_constraint = nullptr;
+        server->cursor->locked = false;
+    }
+}
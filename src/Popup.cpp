@@ -11,6 +11,9 @@ Popup::Popup(wlr_xdg_popup *xdg_popup, wlr_scene_tree *parent_tree,
         Popup *popup = wl_container_of(listener, popup, commit);
         Output *output = popup->server->focused_output();
 
+        // the popup is part of its parent's box in the hit index
+        popup->server->invalidate_hit_index();
+
         if (!output)
             return;
 
@@ -49,6 +52,8 @@ Popup::Popup(wlr_xdg_popup *xdg_popup, wlr_scene_tree *parent_tree,
 }
 
 Popup::~Popup() {
+    server->invalidate_hit_index();
+
     wl_list_remove(&commit.link);
     wl_list_remove(&destroy.link);
     wl_list_remove(&new_popup.link);
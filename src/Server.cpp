@@ -2,18 +2,7 @@
 
 // get workspace by toplevel
 Workspace *Server::get_workspace(Toplevel *toplevel) const {
-    Output *output, *tmp;
-    Workspace *workspace, *tmp1;
-
-    // check each output
-    // for each output check each workspace
-    wl_list_for_each_safe(output, tmp, &output_manager->outputs, link)
-        wl_list_for_each_safe(
-            workspace, tmp1, &output->workspaces,
-            link) if (workspace->contains(toplevel)) return workspace;
-
-    // no workspace found
-    return nullptr;
+    return toplevel ? toplevel->workspace : nullptr;
 }
 
 // get a node tree surface from its location and cast it to the generic
@@ -21,8 +10,18 @@ Workspace *Server::get_workspace(Toplevel *toplevel) const {
 template <typename T>
 T *Server::surface_at(const double lx, const double ly, wlr_surface **surface,
                       double *sx, double *sy) {
-    // get the scene node and ensure it's a buffer
-    wlr_scene_node *node = wlr_scene_node_at(&scene->tree.node, lx, ly, sx, sy);
+    // get the scene node from the index of the output under the point,
+    // moves and resizes invalidate it on every motion so search the scene
+    wlr_scene_node *node;
+    const wlr_output *wlr_output =
+        wlr_output_layout_output_at(output_manager->layout, lx, ly);
+    if (wlr_output && cursor && cursor->cursor_mode == CURSORMODE_PASSTHROUGH)
+        node = static_cast<Output *>(wlr_output->data)
+                   ->hit_index.node_at(lx, ly, sx, sy);
+    else
+        node = wlr_scene_node_at(&scene->tree.node, lx, ly, sx, sy);
+
+    // ensure it's a buffer
     if (!node || node->type != WLR_SCENE_NODE_BUFFER)
         return nullptr;
 
@@ -53,32 +52,39 @@ T *Server::surface_at(const double lx, const double ly, wlr_surface **surface,
     return static_cast<T *>(tree->node.data);
 }
 
-// find a toplevel by location
-Toplevel *Server::toplevel_at(const double lx, const double ly,
-                              wlr_surface **surface, double *sx, double *sy) {
-    Toplevel *toplevel = surface_at<Toplevel>(lx, ly, surface, sx, sy);
+// find the toplevel or layer surface by location with a single lookup, at
+// most one of them is set and only if its surface is mapped
+void Server::target_at(const double lx, const double ly, Toplevel **toplevel,
+                       LayerSurface **layer_surface, wlr_surface **surface,
+                       double *sx, double *sy) {
+    *toplevel = nullptr;
+    *layer_surface = nullptr;
 
-    // ensure role is not layer surface
-    if (toplevel && surface && (*surface)->mapped &&
-        strcmp((*surface)->role->name, "zwlr_layer_surface_v1") != 0)
-        return toplevel;
+    void *data = surface_at<void>(lx, ly, surface, sx, sy);
+    if (!data || !*surface || !(*surface)->mapped)
+        return;
 
-    return nullptr;
+    // the role tells which of the two the node data is
+    if (strcmp((*surface)->role->name, "zwlr_layer_surface_v1") == 0)
+        *layer_surface = static_cast<LayerSurface *>(data);
+    else
+        *toplevel = static_cast<Toplevel *>(data);
 }
 
-// find a layer surface by location
-LayerSurface *Server::layer_surface_at(const double lx, const double ly,
-                                       wlr_surface **surface, double *sx,
-                                       double *sy) {
-    LayerSurface *layer_surface =
-        surface_at<LayerSurface>(lx, ly, surface, sx, sy);
+// get the latency stats of an input device, created on first use
+InputStats *Server::get_input_stats(const wlr_input_device *device) {
+    return &input_stats[device->name ? device->name : ""];
+}
 
-    // ensure role is layer surface
-    if (layer_surface && surface && (*surface)->mapped &&
-        strcmp((*surface)->role->name, "zwlr_layer_surface_v1") == 0)
-        return layer_surface;
+// remember the first input sent to a toplevel since its last commit, to
+// measure when its result reaches the screen
+void Server::note_input(wlr_surface *surface, const uint32_t time_msec) const {
+    if (!surface || !time_msec)
+        return;
 
-    return nullptr;
+    Toplevel *toplevel = get_toplevel(wlr_surface_get_root_surface(surface));
+    if (toplevel && !toplevel->input_time)
+        toplevel->input_time = InputStats::event_time(time_msec);
 }
 
 // get output by wlr_output
@@ -88,25 +94,8 @@ Output *Server::get_output(const wlr_output *wlr_output) const {
 
 // get toplevel by wlr_surface
 Toplevel *Server::get_toplevel(wlr_surface *surface) const {
-    // check each toplevel in each workspace in each output
-    // get the toplevel by the surface
-    // optionally get xwayland toplevels
-    Output *output, *tmp;
-    Workspace *workspace, *tmp1;
-    Toplevel *toplevel, *tmp2;
-    wl_list_for_each_safe(output, tmp, &output_manager->outputs, link)
-        wl_list_for_each_safe(workspace, tmp1, &output->workspaces, link)
-            wl_list_for_each_safe(
-                toplevel, tmp2, &workspace->toplevels,
-                link) if ((toplevel->xdg_toplevel &&
-                           toplevel->xdg_toplevel->base->surface == surface)
-#ifdef XWAYLAND
-                          || (toplevel->xwayland_surface &&
-                              toplevel->xwayland_surface->surface == surface)
-#endif
-                              ) return toplevel;
-
-    return nullptr;
+    const auto it = toplevel_surfaces.find(surface);
+    return it == toplevel_surfaces.end() ? nullptr : it->second;
 }
 
 // get the focused output
@@ -160,6 +149,16 @@ Server::Server(Config *config) : config(config) {
 
     // wlr compositor
     compositor = wlr_compositor_create(display, 6, renderer);
+
+    // watch commits of every surface
+    new_surface.notify = [](wl_listener *listener, void *data) {
+        Server *server = wl_container_of(listener, server, new_surface);
+
+        [[maybe_unused]] Surface *surface =
+            new Surface(server, static_cast<wlr_surface *>(data));
+    };
+    wl_signal_add(&compositor->events.new_surface, &new_surface);
+
     wlr_subcompositor_create(display);
     wlr_data_device_manager_create(display);
 
@@ -171,7 +170,8 @@ Server::Server(Config *config) : config(config) {
     scene_layout =
         wlr_scene_attach_output_layout(scene, output_manager->layout);
 
-    // attach dmabuf to scene
+    // attach dmabuf to scene, the scene sends scanout feedback tranches to
+    // the surface it tries to scan out directly
     if (wlr_linux_dmabuf)
         wlr_scene_set_linux_dmabuf_v1(scene, wlr_linux_dmabuf);
 
@@ -317,8 +317,9 @@ Server::Server(Config *config) : config(config) {
         Server *server = wl_container_of(listener, server, new_input);
 
         // handle device type
-        switch (auto *device = static_cast<wlr_input_device *>(data);
-                device->type) {
+        auto *device = static_cast<wlr_input_device *>(data);
+
+        switch (device->type) {
         case WLR_INPUT_DEVICE_KEYBOARD: {
             // create keyboard
             Keyboard *keyboard = new Keyboard(server, device);
@@ -452,11 +453,26 @@ Server::Server(Config *config) : config(config) {
             wl_container_of(listener, server, new_pointer_constraint);
 
         [[maybe_unused]] PointerConstraint *constraint = new PointerConstraint(
-            static_cast<wlr_pointer_constraint_v1 *>(data));
+            server, static_cast<wlr_pointer_constraint_v1 *>(data));
     };
     wl_signal_add(&wlr_pointer_constraints->events.new_constraint,
                   &new_pointer_constraint);
 
+    // activate the constraint of the surface the pointer entered
+    pointer_focus_change.notify = [](wl_listener *listener, void *data) {
+        Server *server =
+            wl_container_of(listener, server, pointer_focus_change);
+        const auto *event =
+            static_cast<wlr_seat_pointer_focus_change_event *>(data);
+
+        const auto found = server->pointer_constraints.find(event->new_surface);
+        server->cursor->constrain(found == server->pointer_constraints.end()
+                                      ? nullptr
+                                      : found->second);
+    };
+    wl_signal_add(&seat->pointer_state.events.focus_change,
+                  &pointer_focus_change);
+
     // viewporter
     wlr_viewporter = wlr_viewporter_create(display);
 
@@ -500,6 +516,10 @@ Server::Server(Config *config) : config(config) {
     wlr_single_pixel_buffer_manager =
         wlr_single_pixel_buffer_manager_v1_create(display);
 
+    // tearing control
+    wlr_tearing_control_manager =
+        wlr_tearing_control_manager_v1_create(display, 1);
+
     // avoid using "wayland-0" as display socket
     std::string socket;
     for (unsigned int i = 1; i <= 32; i++) {
@@ -571,9 +591,14 @@ Server::Server(Config *config) : config(config) {
 #endif
 
     // start IPC
-    if (config->ipc)
+    if (config->ipc) {
         ipc = new IPC(this);
 
+        // serve i3 and sway tools beside awmsg
+        if (config->i3_ipc)
+            ipc->i3 = new I3IPC(ipc);
+    }
+
     // set up signal handler
     sa.sa_handler = [](int sig) {
         if (sig == SIGCHLD)
@@ -600,23 +625,15 @@ Server::Server(Config *config) : config(config) {
 
     // set envvars from config
     for (const auto &[key, value] : config->startup_env)
-        setenv(key.c_str(), value.c_str(), true);
+        set_env(key, value);
 
     // run startup commands from config
     for (const std::string &command : config->startup_commands)
-        if (fork() == 0)
-            execl("/bin/sh", "/bin/sh", "-c", command.c_str(), nullptr);
-
-    // run thread for config updater
-    config_thread = std::thread([&]() {
-        while (running) {
-            // update config
-            config->update(this);
+        spawn(command);
 
-            // sleep
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-        }
-    });
+    // reload config when its file changes
+    if (!config->path.empty())
+        config_watcher = new ConfigWatcher(this, config->path);
 
     // run event loop
     wlr_log(WLR_INFO, "Running Wayland compositor on WAYLAND_DISPLAY=%s",
@@ -624,28 +641,149 @@ Server::Server(Config *config) : config(config) {
     wl_display_run(display);
 }
 
+// mark the hit indexes of all outputs as stale, call after anything moves,
+// maps, unmaps or is restacked in the scene
+void Server::invalidate_hit_index() { ++hit_generation; }
+
+// set a variable from the config env, remembering the value it replaces
+void Server::set_env(const std::string &key, const std::string &value) {
+    if (!inherited_env.count(key)) {
+        const char *inherited = getenv(key.c_str());
+        inherited_env[key] =
+            inherited ? std::optional<std::string>(inherited) : std::nullopt;
+    }
+
+    setenv(key.c_str(), value.c_str(), true);
+}
+
+// restore a variable dropped from the config env to its inherited value
+void Server::restore_env(const std::string &key) {
+    const auto it = inherited_env.find(key);
+    if (it == inherited_env.end())
+        return;
+
+    if (it->second)
+        setenv(key.c_str(), it->second->c_str(), true);
+    else
+        unsetenv(key.c_str());
+
+    inherited_env.erase(it);
+}
+
 void Server::exit() const {
     wl_display_terminate(display);
 
     // run exit commands
     for (const std::string &command : config->exit_commands)
-        if (fork() == 0)
-            execl("/bin/sh", "/bin/sh", "-c", command.c_str(), nullptr);
+        spawn(command);
+}
 
-    // stop IPC
-    if (ipc)
-        ipc->stop();
+// reload the config file, applying only the sections that changed
+void Server::reload_config() {
+    // ignore reloads without a config file
+    if (config->path.empty())
+        return;
+
+    // check if the file has been modified, it may be mid-replacement
+    std::error_code ec;
+    const std::filesystem::file_time_type write_time =
+        std::filesystem::last_write_time(config->path, ec);
+    if (ec || write_time == config->last_write_time)
+        return;
+
+    // parse into a new config, keep the active one if it fails
+    auto *next = new Config(config->path);
+    if (!next->loaded) {
+        delete next;
+        return;
+    }
+
+    // swap in the new config
+    const Config *previous = config;
+    config = next;
+
+    // recompile the keymap only if the rules changed, it is slow
+    const bool keymap =
+        config->keyboard_layout != previous->keyboard_layout ||
+        config->keyboard_model != previous->keyboard_model ||
+        config->keyboard_variant != previous->keyboard_variant ||
+        config->keyboard_options != previous->keyboard_options;
+    const bool repeat = config->repeat_rate != previous->repeat_rate ||
+                        config->repeat_delay != previous->repeat_delay;
+
+    // bind tables, commands themselves are read from the config when run
+    const bool binds = config->bind_table != previous->bind_table;
+
+    Keyboard *keyboard, *keyboard_tmp;
+    wl_list_for_each_safe(keyboard, keyboard_tmp, &keyboards, link) {
+        if (keymap)
+            keyboard->update_keymap();
+        else if (binds)
+            keyboard->compile_binds();
+
+        if (repeat)
+            keyboard->update_repeat();
+    }
+
+    // pointer settings
+    if (!(config->cursor == previous->cursor))
+        cursor->reconfigure_all();
+
+    // env for commands spawned from now on
+    for (const auto &pair : config->startup_env)
+        if (std::find(previous->startup_env.begin(),
+                      previous->startup_env.end(),
+                      pair) == previous->startup_env.end())
+            set_env(pair.first, pair.second);
+
+    for (const auto &[key, value] : previous->startup_env)
+        if (std::none_of(config->startup_env.begin(), config->startup_env.end(),
+                         [&](const auto &pair) { return pair.first == key; }))
+            restore_env(key);
+
+    // monitors whose config was added or changed
+    bool outputs_changed = false;
+    Output *output, *output_tmp;
+    wl_list_for_each_safe(output, output_tmp, &output_manager->outputs, link) {
+        const OutputConfig *current =
+            config->output_config(output->wlr_output->name);
+        const OutputConfig *old =
+            previous->output_config(output->wlr_output->name);
+
+        if (current && (!old || !(*current == *old)))
+            outputs_changed |= output->apply_config(current, false);
+
+        output->render_delay = current ? current->render_delay : 0;
+        output->frame_delay = current && current->frame_delay;
+        output->allow_tearing = current && current->allow_tearing;
+    }
+
+    if (outputs_changed) {
+        output_manager->arrange();
+
+        // notify subscribers
+        if (ipc)
+            ipc->notify(IPC_EVENT_OUTPUT);
+    }
+
+    delete previous;
+
+    // notify user of reload
+    notify_send("%s", "config reload complete");
 }
 
 Server::~Server() {
     wl_display_destroy_clients(display);
 
-    running = false;
-    if (config_thread.joinable())
-        config_thread.join();
+    // stop IPC, outputs and toplevels destroyed below check for it
+    if (ipc) {
+        ipc->stop();
+        ipc = nullptr;
+    }
 
-    delete output_manager;
+    delete config_watcher;
 
+    wl_list_remove(&new_surface.link);
     wl_list_remove(&new_xdg_toplevel.link);
 
     wl_list_remove(&new_input.link);
@@ -660,6 +798,7 @@ Server::~Server() {
     wl_list_remove(&new_session_lock.link);
     wl_list_remove(&new_virtual_pointer.link);
     wl_list_remove(&new_pointer_constraint.link);
+    wl_list_remove(&pointer_focus_change.link);
 
     LayerSurface *surface, *tmp;
     wl_list_for_each_safe(surface, tmp, &layer_surfaces, link) delete surface;
@@ -670,6 +809,11 @@ Server::~Server() {
     wlr_xwayland_destroy(xwayland);
 #endif
 
+    // outputs are destroyed with the backend below, their workspaces see
+    // no manager and drop their toplevels
+    delete output_manager;
+    output_manager = nullptr;
+
     wlr_scene_node_destroy(&scene->tree.node);
 
     delete cursor;
@@ -3,6 +3,7 @@
 SessionLock::SessionLock(Server *server, wlr_session_lock_v1 *session_lock)
     : server(server), session_lock(session_lock) {
     scene_tree = wlr_scene_tree_create(server->layers.lock);
+    server->invalidate_hit_index();
 
     new_surface.notify = [](wl_listener *listener, void *data) {
         SessionLock *lock = wl_container_of(listener, lock, new_surface);
@@ -71,6 +72,7 @@ SessionLock::SessionLock(Server *server, wlr_session_lock_v1 *session_lock)
 
         // destroy lock
         wlr_scene_node_destroy(&lock->scene_tree->node);
+        server->invalidate_hit_index();
         server->current_session_lock = nullptr;
 
         // unlock
@@ -0,0 +1,138 @@
+#include "Server.h"
+#include <csignal>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+extern char **environ;
+
+// compositor end of the socket to the helper
+static int spawner_fd = -1;
+
+// launch /bin/sh -c command with envp, the child gets default signal
+// handling back
+static void spawn_shell(const char *command, char *const envp[]) {
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGCHLD);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGTERM);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+
+    posix_spawnattr_setflags(&attr,
+                             POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    pid_t pid;
+    char *const argv[] = {const_cast<char *>("/bin/sh"),
+                          const_cast<char *>("-c"),
+                          const_cast<char *>(command), nullptr};
+    const int err = posix_spawn(&pid, "/bin/sh", nullptr, &attr, argv, envp);
+    if (err)
+        wlr_log(WLR_ERROR, "failed to spawn '%s': %s", command, strerror(err));
+
+    posix_spawnattr_destroy(&attr);
+}
+
+// helper main loop, each message is a command followed by the environment to
+// run it in, all nul terminated
+[[noreturn]] static void spawner_run(const int fd) {
+    // children are reaped automatically
+    signal(SIGCHLD, SIG_IGN);
+
+    // the compositor decides when to stop, the helper exits with it
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTERM, SIG_IGN);
+
+    std::vector<char> buffer;
+    std::vector<char *> envp;
+
+    while (true) {
+        // get size of the next message
+        const ssize_t size = recv(fd, nullptr, 0, MSG_PEEK | MSG_TRUNC);
+        if (size <= 0) {
+            if (size == -1 && errno == EINTR)
+                continue;
+
+            // compositor is gone
+            _exit(0);
+        }
+
+        // read message
+        buffer.resize(size + 1);
+        if (recv(fd, buffer.data(), size, 0) != size)
+            continue;
+        buffer[size] = '\0';
+
+        // split command and environment
+        const char *command = buffer.data();
+        envp.clear();
+        for (char *p = buffer.data() + strlen(command) + 1;
+             p < buffer.data() + size; p += strlen(p) + 1)
+            envp.push_back(p);
+        envp.push_back(nullptr);
+
+        spawn_shell(command, envp.data());
+    }
+}
+
+void spawner_start() {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1) {
+        wlr_log(WLR_ERROR, "failed to create spawn helper socket: %s",
+                strerror(errno));
+        return;
+    }
+
+    const pid_t pid = fork();
+    if (pid == -1) {
+        wlr_log(WLR_ERROR, "failed to fork spawn helper: %s", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return;
+    }
+
+    // helper
+    if (pid == 0) {
+        close(fds[0]);
+        spawner_run(fds[1]);
+    }
+
+    close(fds[1]);
+    spawner_fd = fds[0];
+}
+
+void spawn(const std::string &command) {
+    // without a helper spawn directly, posix_spawn does not copy the
+    // address space either
+    if (spawner_fd == -1) {
+        spawn_shell(command.c_str(), environ);
+        return;
+    }
+
+    // command followed by the current environment
+    std::string message = command;
+    message += '\0';
+    for (char **env = environ; *env; ++env) {
+        message += *env;
+        message += '\0';
+    }
+
+    if (send(spawner_fd, message.data(), message.size(), MSG_NOSIGNAL) ==
+        -1) {
+        wlr_log(WLR_ERROR, "spawn helper failed: %s", strerror(errno));
+
+        // fall back to spawning directly from now on
+        close(spawner_fd);
+        spawner_fd = -1;
+        spawn_shell(command.c_str(), environ);
+    }
+}
@@ -0,0 +1,37 @@
+#include "Server.h"
+
+Surface::Surface(Server *server, wlr_surface *surface)
+    : server(server), surface(surface) {
+    // commit
+    commit.notify = [](wl_listener *listener, [[maybe_unused]] void *data) {
+        Surface *surface = wl_container_of(listener, surface, commit);
+
+        // main surfaces are handled by their role
+        wlr_surface *committed = surface->surface;
+        if (!wlr_subsurface_try_from_wlr_surface(committed))
+            return;
+
+        // the subsurface grew or shrank under the cursor
+        if (committed->current.width != committed->previous.width ||
+            committed->current.height != committed->previous.height)
+            surface->server->invalidate_hit_index();
+
+        // clients presenting from a subsurface show input with its buffers
+        if (Toplevel *toplevel = surface->server->get_toplevel(
+                wlr_surface_get_root_surface(committed)))
+            toplevel->commit_input(committed);
+    };
+    wl_signal_add(&surface->events.commit, &commit);
+
+    // destroy
+    destroy.notify = [](wl_listener *listener, [[maybe_unused]] void *data) {
+        Surface *surface = wl_container_of(listener, surface, destroy);
+        delete surface;
+    };
+    wl_signal_add(&surface->events.destroy, &destroy);
+}
+
+Surface::~Surface() {
+    wl_list_remove(&commit.link);
+    wl_list_remove(&destroy.link);
+}
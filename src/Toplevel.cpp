@@ -1,8 +1,13 @@
 #include "Server.h"
+#include <sys/timerfd.h>
+
+// time left between the expected commit of a client and the render, in ns
+constexpr uint64_t FRAME_DELAY_MARGIN = 2000000;
 
 void Toplevel::map_notify(wl_listener *listener, [[maybe_unused]] void *data) {
     // on map or display
     Toplevel *toplevel = wl_container_of(listener, toplevel, map);
+    toplevel->server->invalidate_hit_index();
 
     // xdg toplevel
     if (const wlr_xdg_toplevel *xdg_toplevel = toplevel->xdg_toplevel) {
@@ -126,6 +131,16 @@ void Toplevel::map_notify(wl_listener *listener, [[maybe_unused]] void *data) {
                     new_box.height != toplevel->saved_geometry.height)
                     memcpy(&toplevel->saved_geometry, &new_box,
                            sizeof(wlr_box));
+
+                // the surface grew or shrank under the cursor
+                const wlr_surface *surface =
+                    toplevel->xwayland_surface->surface;
+                if (state->width != surface->previous.width ||
+                    state->height != surface->previous.height)
+                    toplevel->server->invalidate_hit_index();
+
+                toplevel->commit_input(surface);
+                toplevel->record_client_time();
             };
             wl_signal_add(&toplevel->xwayland_surface->surface->events.commit,
                           &toplevel->xwayland_commit);
@@ -141,22 +156,34 @@ void Toplevel::map_notify(wl_listener *listener, [[maybe_unused]] void *data) {
         }
     }
 #endif
+
+    // notify subscribers
+    if (IPC *ipc = toplevel->server->ipc) {
+        ipc->notify_toplevel("map", toplevel);
+        ipc->notify(IPC_EVENT_FOCUS);
+    }
 }
 
 void Toplevel::unmap_notify(wl_listener *listener,
                             [[maybe_unused]] void *data) {
     Toplevel *toplevel = wl_container_of(listener, toplevel, unmap);
+    toplevel->server->invalidate_hit_index();
 
     // deactivate
     if (toplevel == toplevel->server->grabbed_toplevel)
         toplevel->server->cursor->reset_mode();
 
+    // notify subscribers
+    if (IPC *ipc = toplevel->server->ipc) {
+        ipc->notify_toplevel("unmap", toplevel);
+        ipc->notify(IPC_EVENT_FOCUS);
+    }
+
     // remove from workspace
-    if (Workspace *workspace = toplevel->server->get_workspace(toplevel))
+    if (Workspace *workspace = toplevel->workspace) {
         workspace->close(toplevel);
-
-    // remove link
-    wl_list_remove(&toplevel->link);
+        workspace->remove_toplevel(toplevel);
+    }
 }
 
 // create a foreign toplevel handle
@@ -217,6 +244,7 @@ void Toplevel::create_handle() {
             "%s",
             "Minimizing foreign toplevels is not supported, expect issues");
         wlr_scene_node_lower_to_bottom(&toplevel->scene_tree->node);
+        toplevel->server->invalidate_hit_index();
 
         toplevel->update_foreign_toplevel();
     };
@@ -304,7 +332,9 @@ void Toplevel::create_handle() {
 
 // Toplevel from xdg toplevel
 Toplevel::Toplevel(Server *server, wlr_xdg_toplevel *xdg_toplevel)
-    : server(server), xdg_toplevel(xdg_toplevel) {
+    : server(server), id(server->next_id++), xdg_toplevel(xdg_toplevel) {
+    server->toplevels[id] = this;
+
     // add the toplevel to the scene tree
     scene_tree = wlr_scene_xdg_surface_create(server->layers.floating,
                                               xdg_toplevel->base);
@@ -330,6 +360,23 @@ Toplevel::Toplevel(Server *server, wlr_xdg_toplevel *xdg_toplevel)
         if (toplevel->xdg_toplevel->base->initial_commit)
             // let client pick dimensions
             wlr_xdg_toplevel_set_size(toplevel->xdg_toplevel, 0, 0);
+
+        // the surface grew or shrank under the cursor
+        const wlr_surface *surface = toplevel->xdg_toplevel->base->surface;
+        if (surface->current.width != surface->previous.width ||
+            surface->current.height != surface->previous.height)
+            toplevel->server->invalidate_hit_index();
+
+        toplevel->commit_input(surface);
+        toplevel->record_client_time();
+
+        // an acked configure may change the maximized or fullscreen state
+        const uint32_t serial =
+            toplevel->xdg_toplevel->base->current.configure_serial;
+        if (serial != toplevel->configure_serial) {
+            toplevel->configure_serial = serial;
+            toplevel->invalidate_ipc();
+        }
     };
     wl_signal_add(&xdg_toplevel->base->surface->events.commit, &commit);
 
@@ -343,6 +390,19 @@ Toplevel::Toplevel(Server *server, wlr_xdg_toplevel *xdg_toplevel)
     };
     wl_signal_add(&xdg_toplevel->base->events.new_popup, &new_xdg_popup);
 
+    // set_title
+    set_title.notify = [](wl_listener *listener, [[maybe_unused]] void *data) {
+        Toplevel *toplevel = wl_container_of(listener, toplevel, set_title);
+
+        if (toplevel->xdg_toplevel->title)
+            wlr_foreign_toplevel_handle_v1_set_title(
+                toplevel->handle, toplevel->xdg_toplevel->title);
+
+        toplevel->invalidate_ipc();
+        toplevel->notify_title();
+    };
+    wl_signal_add(&xdg_toplevel->events.set_title, &set_title);
+
     // xdg_toplevel_destroy
     destroy.notify = [](wl_listener *listener, [[maybe_unused]] void *data) {
         Toplevel *toplevel = wl_container_of(listener, toplevel, destroy);
@@ -400,6 +460,7 @@ Toplevel::Toplevel(Server *server, wlr_xdg_toplevel *xdg_toplevel)
 
         // move toplevel to the bottom
         wlr_scene_node_lower_to_bottom(&toplevel->scene_tree->node);
+        toplevel->server->invalidate_hit_index();
 
         // focus the next toplevel in the workspace
         if (Workspace *workspace = toplevel->server->get_workspace(toplevel))
@@ -409,6 +470,25 @@ Toplevel::Toplevel(Server *server, wlr_xdg_toplevel *xdg_toplevel)
 }
 
 Toplevel::~Toplevel() {
+    server->invalidate_hit_index();
+
+    if (frame_timer)
+        wl_event_source_remove(frame_timer);
+    if (frame_timer_fd != -1)
+        ::close(frame_timer_fd);
+
+    // remove from registry
+    server->toplevels.erase(id);
+    for (const auto &[surface, constraint] : server->pointer_constraints)
+        if (constraint->toplevel == this)
+            constraint->toplevel = nullptr;
+    if (committed_input_time)
+        server->committed_inputs.erase(
+            std::find(server->committed_inputs.begin(),
+                      server->committed_inputs.end(), this));
+    if (workspace)
+        workspace->remove_toplevel(this);
+
 #ifdef XWAYLAND
     if (xwayland_surface) {
         wl_list_remove(&activate.link);
@@ -436,6 +516,7 @@ Toplevel::~Toplevel() {
 #endif
 
     wl_list_remove(&destroy.link);
+    wl_list_remove(&set_title.link);
     wl_list_remove(&handle_request_maximize.link);
     wl_list_remove(&handle_request_minimize.link);
     wl_list_remove(&handle_request_fullscreen.link);
@@ -448,7 +529,10 @@ Toplevel::~Toplevel() {
 #ifdef XWAYLAND
 // Toplevel from xwayland surface
 Toplevel::Toplevel(Server *server, wlr_xwayland_surface *xwayland_surface)
-    : server(server), xwayland_surface(xwayland_surface) {
+    : server(server), id(server->next_id++),
+      xwayland_surface(xwayland_surface) {
+    server->toplevels[id] = this;
+
     // create foreign toplevel handle
     create_handle();
 
@@ -459,6 +543,19 @@ Toplevel::Toplevel(Server *server, wlr_xwayland_surface *xwayland_surface)
     };
     wl_signal_add(&xwayland_surface->events.destroy, &destroy);
 
+    // set_title
+    set_title.notify = [](wl_listener *listener, [[maybe_unused]] void *data) {
+        Toplevel *toplevel = wl_container_of(listener, toplevel, set_title);
+
+        if (toplevel->xwayland_surface->title)
+            wlr_foreign_toplevel_handle_v1_set_title(
+                toplevel->handle, toplevel->xwayland_surface->title);
+
+        toplevel->invalidate_ipc();
+        toplevel->notify_title();
+    };
+    wl_signal_add(&xwayland_surface->events.set_title, &set_title);
+
     // activate
     activate.notify = [](wl_listener *listener, [[maybe_unused]] void *data) {
         Toplevel *toplevel = wl_container_of(listener, toplevel, activate);
@@ -586,6 +683,17 @@ Toplevel::Toplevel(Server *server, wlr_xwayland_surface *xwayland_surface)
 }
 #endif
 
+// get the main surface, nullptr if there is none
+wlr_surface *Toplevel::surface() const {
+    if (xdg_toplevel)
+        return xdg_toplevel->base->surface;
+#ifdef XWAYLAND
+    if (xwayland_surface)
+        return xwayland_surface->surface;
+#endif
+    return nullptr;
+}
+
 // focus keyboard to surface
 void Toplevel::focus() const {
     // locked
@@ -643,6 +751,7 @@ void Toplevel::focus() const {
 
         // move toplevel node to top of scene tree
         wlr_scene_node_raise_to_top(&scene_tree->node);
+        server->invalidate_hit_index();
 
         // activate toplevel
         if (xdg_toplevel)
@@ -766,6 +875,8 @@ void Toplevel::set_position_size(const double x, const double y, int width,
 #endif
 
     geometry = wlr_box{static_cast<int>(x), static_cast<int>(y), width, height};
+    invalidate_ipc();
+    server->invalidate_hit_index();
 }
 
 void Toplevel::set_position_size(const wlr_box &geometry) {
@@ -774,6 +885,9 @@ void Toplevel::set_position_size(const wlr_box &geometry) {
 
 // get the geometry of the toplevel
 wlr_box Toplevel::get_geometry() {
+    const wlr_box previous = geometry;
+    wlr_box box;
+
 #ifdef XWAYLAND
     if (xdg_toplevel) {
 #endif
@@ -783,21 +897,30 @@ wlr_box Toplevel::get_geometry() {
         geometry.height = xdg_toplevel->base->surface->current.height;
 
         // this is called lying
-        return xdg_toplevel->base->geometry;
+        box = xdg_toplevel->base->geometry;
 #ifdef XWAYLAND
     } else {
         geometry.x = xwayland_surface->x;
         geometry.y = xwayland_surface->y;
         geometry.width = xwayland_surface->surface->current.width;
         geometry.height = xwayland_surface->surface->current.height;
-        return geometry;
+        box = geometry;
     }
 #endif
+
+    if (memcmp(&previous, &geometry, sizeof(wlr_box)))
+        invalidate_ipc();
+
+    return box;
 }
 
 // set the visibility of the toplevel
 void Toplevel::set_hidden(const bool hidden) {
-    this->hidden = hidden;
+    if (this->hidden != hidden) {
+        this->hidden = hidden;
+        invalidate_ipc();
+        server->invalidate_hit_index();
+    }
 
 #ifdef XWAYLAND
     if (xdg_toplevel)
@@ -866,6 +989,7 @@ void Toplevel::set_fullscreen(const bool fullscreen) {
     } else {
         // move scene tree node to toplevel tree
         wlr_scene_node_reparent(&scene_tree->node, server->layers.floating);
+        server->invalidate_hit_index();
 
         // set back to saved geometry
         set_position_size(saved_geometry.x, saved_geometry.y,
@@ -966,6 +1090,125 @@ std::string Toplevel::title() const {
     return xdg_toplevel->title ? xdg_toplevel->title : "";
 }
 
+std::string Toplevel::app_id() const {
+#ifdef XWAYLAND
+    if (xwayland_surface)
+        return xwayland_surface->class_ ? xwayland_surface->class_ : "";
+#endif
+    return xdg_toplevel->app_id ? xdg_toplevel->app_id : "";
+}
+
+// a commit of a new buffer to a surface of the toplevel after an input is
+// taken to show its result, queue it for the next output frame
+void Toplevel::commit_input(const wlr_surface *surface) {
+    // configure acks and other commits without a new buffer show nothing
+    if (!input_time || !(surface->current.committed & WLR_SURFACE_STATE_BUFFER))
+        return;
+
+    if (!committed_input_time) {
+        committed_input_time = input_time;
+        server->committed_inputs.push_back(this);
+    }
+
+    input_time = 0;
+}
+
+// measure how long the client took to commit after frame done
+void Toplevel::record_client_time() {
+    if (!frame_done_time)
+        return;
+
+    timespec time{};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    const uint64_t elapsed = static_cast<uint64_t>(time.tv_sec) * 1000000000 +
+                             time.tv_nsec - frame_done_time;
+    frame_done_time = 0;
+
+    // a client idle for a whole frame was not rendering
+    if (output && elapsed < output->refresh_period)
+        client_times[client_time_count++ % client_times.size()] = elapsed;
+}
+
+// send frame done so the client commits a margin before the deadline, using
+// the slowest of its recent frames, both in ns
+void Toplevel::schedule_frame_done(const uint64_t deadline,
+                                   const uint64_t now) {
+    // not enough samples yet
+    uint64_t delay = 0;
+    if (client_time_count >= client_times.size()) {
+        const uint64_t budget =
+            *std::max_element(client_times.begin(), client_times.end()) +
+            FRAME_DELAY_MARGIN;
+
+        if (deadline > now + budget)
+            delay = deadline - now - budget;
+    }
+
+    // shown by output frames, which is not cached
+    frame_delay = delay / 1000000;
+
+    // create the timer on first use
+    if (delay && frame_timer_fd == -1) {
+        frame_timer_fd =
+            timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (frame_timer_fd == -1)
+            wlr_log(WLR_ERROR, "failed to create frame timer: %s",
+                    strerror(errno));
+        else
+            frame_timer = wl_event_loop_add_fd(
+                wl_display_get_event_loop(server->display), frame_timer_fd,
+                WL_EVENT_READABLE,
+                [](int fd, uint32_t, void *data) {
+                    uint64_t expirations;
+                    if (read(fd, &expirations, sizeof(expirations)) > 0)
+                        static_cast<Toplevel *>(data)->send_frame_done();
+                    return 0;
+                },
+                this);
+    }
+
+    // arm, or disarm and send right away
+    itimerspec timer{};
+    timer.it_value.tv_sec = delay / 1000000000;
+    timer.it_value.tv_nsec = delay % 1000000000;
+    if (frame_timer_fd == -1 ||
+        timerfd_settime(frame_timer_fd, 0, &timer, nullptr) == -1 || !delay)
+        send_frame_done();
+}
+
+// send frame done to the buffers of the toplevel and its popups
+void Toplevel::send_frame_done() {
+    timespec time{};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    wlr_scene_node_for_each_buffer(
+        &scene_tree->node,
+        [](wlr_scene_buffer *buffer, int, int, void *data) {
+            if (buffer->primary_output)
+                wlr_scene_buffer_send_frame_done(
+                    buffer, static_cast<timespec *>(data));
+        },
+        &time);
+
+    frame_done_time =
+        static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+// mark the IPC listings showing toplevels as stale
+void Toplevel::invalidate_ipc() const {
+    if (server->ipc)
+        server->ipc->invalidate(IPC_SNAPSHOT_WORKSPACES |
+                                IPC_SNAPSHOT_TOPLEVELS);
+}
+
+// tell subscribers about title changes of mapped toplevels
+void Toplevel::notify_title() {
+    IPC *ipc = server->ipc;
+    if (ipc && ipc->subscribed(IPC_EVENT_TOPLEVEL) &&
+        server->get_workspace(this))
+        ipc->notify_toplevel("title", this);
+}
+
 // tell the toplevel to close
 void Toplevel::close() const {
 #ifdef XWAYLAND
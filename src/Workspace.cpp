@@ -2,10 +2,55 @@
 #include <climits>
 
 Workspace::Workspace(Output *output, const uint32_t num)
-    : num(num), output(output) {
+    : id(output->server->next_id++), num(num), output(output) {
     wl_list_init(&toplevels);
 }
 
+Workspace::~Workspace() {
+    Server *server = output->server;
+
+    // toplevels go to the active workspace of another output, if any is
+    // left and the server is not shutting down
+    Workspace *target = nullptr;
+    Output *other;
+    if (server->output_manager)
+        wl_list_for_each(other, &server->output_manager->outputs, link)
+            if (other != output) {
+                target = other->get_active();
+                break;
+            }
+
+    Toplevel *toplevel, *tmp;
+    wl_list_for_each_safe(toplevel, tmp, &toplevels, link) {
+        remove_toplevel(toplevel);
+        if (!target)
+            continue;
+
+        target->add_toplevel(toplevel, false);
+        toplevel->set_hidden(false);
+
+        // keep the offset from the output origin, inside the new output
+        const wlr_box &from = output->layout_geometry;
+        const wlr_box &to = target->output->layout_geometry;
+        const int x = std::clamp(toplevel->geometry.x - from.x, 0,
+                                 std::max(0, to.width - 1)) +
+                      to.x;
+        const int y = std::clamp(toplevel->geometry.y - from.y, 0,
+                                 std::max(0, to.height - 1)) +
+                      to.y;
+        wlr_scene_node_set_position(&toplevel->scene_tree->node, x, y);
+        toplevel->geometry.x = x;
+        toplevel->geometry.y = y;
+        toplevel->invalidate_ipc();
+
+        // notify subscribers
+        if (server->ipc)
+            server->ipc->notify_toplevel("move", toplevel);
+    }
+
+    server->invalidate_hit_index();
+}
+
 // add a toplevel to the workspace
 void Workspace::add_toplevel(Toplevel *toplevel, const bool focus) {
     // ensure toplevel is not already in workspace
@@ -14,6 +59,18 @@ void Workspace::add_toplevel(Toplevel *toplevel, const bool focus) {
 
     // add to toplevels list
     wl_list_insert(&toplevels, &toplevel->link);
+    toplevel->workspace = this;
+    toplevel->output = output;
+
+    // register the surface for lookups, along with its pointer constraint
+    if (wlr_surface *surface = toplevel->surface()) {
+        Server *server = output->server;
+        server->toplevel_surfaces[surface] = toplevel;
+
+        if (const auto it = server->pointer_constraints.find(surface);
+            it != server->pointer_constraints.end())
+            it->second->toplevel = toplevel;
+    }
 
     // set active
     active_toplevel = toplevel;
@@ -23,6 +80,31 @@ void Workspace::add_toplevel(Toplevel *toplevel, const bool focus) {
         toplevel->focus();
 }
 
+// remove a toplevel from the workspace without changing focus
+void Workspace::remove_toplevel(Toplevel *toplevel) {
+    if (!contains(toplevel))
+        return;
+
+    wl_list_remove(&toplevel->link);
+    wl_list_init(&toplevel->link);
+    toplevel->workspace = nullptr;
+    toplevel->output = nullptr;
+
+    if (active_toplevel == toplevel)
+        active_toplevel = nullptr;
+
+    // unregister the surface, its pointer constraint no longer has a
+    // toplevel
+    if (wlr_surface *surface = toplevel->surface()) {
+        Server *server = output->server;
+        server->toplevel_surfaces.erase(surface);
+
+        if (const auto it = server->pointer_constraints.find(surface);
+            it != server->pointer_constraints.end())
+            it->second->toplevel = nullptr;
+    }
+}
+
 // close a toplevel
 void Workspace::close(const Toplevel *toplevel) {
     if (!toplevel)
@@ -56,17 +138,7 @@ void Workspace::close_active() {
 
 // returns true if the workspace contains the passed toplevel
 bool Workspace::contains(const Toplevel *toplevel) const {
-    // no toplevels
-    if (wl_list_empty(&toplevels))
-        return false;
-
-    // check if toplevel is in workspace
-    Toplevel *current, *tmp;
-    wl_list_for_each_safe(current, tmp, &toplevels,
-                          link) if (current == toplevel) return true;
-
-    // toplevel not found
-    return false;
+    return toplevel && toplevel->workspace == this;
 }
 
 // move a toplevel to another workspace, returns true on success
@@ -84,6 +156,7 @@ bool Workspace::move_to(Toplevel *toplevel, Workspace *workspace) {
 
         // move to other workspace
         wl_list_remove(&toplevel->link);
+        toplevel->workspace = nullptr;
         workspace->add_toplevel(toplevel, true);
 
         // Update active_toplevel if necessary
@@ -96,6 +169,12 @@ bool Workspace::move_to(Toplevel *toplevel, Workspace *workspace) {
                 active_toplevel = nullptr;
         }
 
+        // notify subscribers
+        if (IPC *ipc = output->server->ipc) {
+            ipc->notify_toplevel("move", toplevel);
+            ipc->notify(IPC_EVENT_FOCUS);
+        }
+
         return true;
     }
 
@@ -111,14 +190,17 @@ void Workspace::set_hidden(const bool hidden) const {
 }
 
 // swap the active toplevel geometry with other toplevel geometry
-void Workspace::swap(Toplevel *other) const {
+void Workspace::swap(Toplevel *other) const { swap(active_toplevel, other); }
+
+// swap the geometry of two toplevels
+void Workspace::swap(Toplevel *a, Toplevel *b) const {
     // get the geometry of both toplevels
-    const wlr_box active = active_toplevel->get_geometry();
-    const wlr_box swapped = other->get_geometry();
+    const wlr_box first = a->get_geometry();
+    const wlr_box second = b->get_geometry();
 
     // swap the geometry
-    active_toplevel->set_position_size(swapped);
-    other->set_position_size(active);
+    a->set_position_size(second);
+    b->set_position_size(first);
 }
 
 // get the toplevel relative to the active one in the specified direction
@@ -216,6 +298,10 @@ void Workspace::focus_toplevel(Toplevel *toplevel) {
 
     // call keyboard focus
     toplevel->focus();
+
+    // notify subscribers
+    if (IPC *ipc = output->server->ipc)
+        ipc->notify(IPC_EVENT_FOCUS);
 }
 
 // focus the toplevel following the active one, looping around to the start
@@ -7,6 +7,9 @@ int main(const int argc, char *argv[]) {
     // start logger
     wlr_log_init(WLR_DEBUG, nullptr);
 
+    // fork the spawn helper while the address space is small
+    spawner_start();
+
     // startup and config
     std::string startup_cmd, config_path;
     const std::string usage =
@@ -82,8 +85,9 @@ int main(const int argc, char *argv[]) {
     if (!startup_cmd.empty())
         config->startup_commands.push_back(startup_cmd);
 
-    // start server
+    // start server, reloads replace its config
     Server *server = Server::get(config);
+    config = server->config;
     delete server;
     delete config;
 }